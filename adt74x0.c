@@ -3,9 +3,109 @@
   * A very simple user space program to read the temperature
   * from ADT7410 and ADT7420 I2C sensors.
   *
-  * usage: adt74x0 /dev/i2c-0
+  * usage: adt74x0 [-a ranges] [-b backend] [-c cache] [-e gpios] [-f format]
+  *                [-i interval] [-l limits] [-m mode] [-p pin] [-r bits]
+  *                [-s] [-t clock] [-w] [/dev/i2c-N ...]
   *
-  * Feature free but works on the Raspberry Pi where the I2C
+  * By default the chips are reset, read once as soon as the STATUS
+  * register says the first conversion is done, and the program exits.
+  * With -i the chips are initialized once and then read every interval
+  * seconds (fractions allowed) until the program is killed, which saves
+  * the reset and the wait on every sample. Sweeps are kept to a fixed
+  * grid of absolute times, so they don't drift however long each takes.
+  *
+  * -m picks how the chips convert:
+  *
+  *   cts     - continuously, flat out (the default)
+  *   1sps    - once a second, so there's no point in -i less than 1
+  *   oneshot - only when asked: each sweep triggers a conversion, waits
+  *             for it, and reads the result. The chips sit shut down in
+  *             between, which saves power and self-heating, and with
+  *             a long -i there's much less bus traffic.
+  *
+  * -r 13 selects 13 bit (1/16C) rather than 16 bit (1/128C) readings.
+  *
+  * -s staggers the chips with -i: rather than the whole bus being read
+  * in a burst at the start of each interval, each chip gets its own
+  * slot spread evenly across it. In one-shot mode each chip is
+  * triggered a conversion time before its slot. So the bus is kept
+  * evenly busy rather than saturated then idle, and many more chips
+  * fit in a short interval, but chips are read one at a time rather
+  * than in a single rdwr ioctl.
+  *
+  * Chips are found by probing each address in -a, hex ranges like
+  * 48-4b,4f (by default 48-4b, which is all an ADT74x0 can be), without
+  * writing anything. On a good bus they must have the right IDREG.
+  * Otherwise anything which answers would do, so then only 48-4b can
+  * be probed, lest some other device be reset and written to.
+  * -c names a file in which to keep what was found, so the next start
+  * with the same bus and ranges can skip probing. If a chip in it has
+  * gone, the bus is probed again. A new chip won't be noticed though,
+  * until the file is removed.
+  *
+  * -l low:high[:crit[:hyst]] sets the chips' T_LOW, T_HIGH, T_CRIT and
+  * T_HYST (in C, though hyst is whole degrees from 0 to 15). Otherwise
+  * the chips keep their own: 10, 64, 147 and 5 after a reset.
+  * Readings which have passed a limit are marked e.g. "0x48 70.00000C
+  * high", and in binary records too. That's free in 13 bit mode where
+  * the chip sends the flags with the temperature, but in 16 bit mode
+  * with -l it costs reading STATUS after each reading.
+  *
+  * -p picks how INT behaves: interrupt (the default) goes active when
+  * a limit's passed and stays so until STATUS is read, comparator stays
+  * active for as long as the limit's passed (less the hysteresis).
+  * CT is always a comparator, for T_CRIT.
+  *
+  * -e makes the program wait for the chips to say they've passed a
+  * limit rather than polling them. Wire INT (and/or CT) to GPIO lines
+  * given like /dev/gpiochip0:17,27, one -e for each bus in order. On a
+  * falling edge every chip on the bus has STATUS read, and those which
+  * have passed a limit are read and reported. CT, and INT with -p
+  * comparator, hold the line low while their chip is past the limit,
+  * which would hide edges from other chips sharing it, so until it's
+  * let go STATUS is read every WATCH_POLL_MS instead. With -i there's
+  * a sweep every interval as well, otherwise the bus is left alone.
+  *
+  * -w attaches warm: chips whose CONFIG already matches aren't reset,
+  * so they're read straight away rather than after a fresh conversion.
+  * Handy when restarting a long running -i. It needs CONFIG to be
+  * readable, so on a bus where that fails chips are just reset.
+  *
+  * Each chip gets its own handle (see adt74x0_dev.h) which, with the
+  * smbus backend, is its own fd with the chip's address selected once,
+  * so the I2C_SLAVE ioctl isn't needed before every transfer.
+  *
+  * Failed reads are retried a couple of times, and chips which keep
+  * failing are left alone for longer and longer (see adt74x0_dev.h).
+  *
+  * Several buses can be given, and each is scanned by its own thread
+  * so a slow bus doesn't hold up the others. The bcm2835 backend only
+  * knows about one bus though, so it takes a single path. Readings are
+  * passed through lock-free rings to a separate output thread, so a
+  * slow stdout can't hold up sampling either: if it gets too far
+  * behind, readings are dropped and counted.
+  *
+  * Readings are written as text lines like "0x48 23.12500C", or with
+  * -f binary as fixed size records described in adt74x0_out.h. With
+  * more than one bus text lines start with the bus number e.g. "1:0x48".
+  *
+  * Every reading is timestamped half way through its bus transaction by
+  * CLOCK_MONOTONIC. -t mono puts that time at the start of text lines;
+  * -t real puts CLOCK_REALTIME there instead, and in binary records too.
+  *
+  * The bus is driven by one of several backends (see i2c_bus.h):
+  *
+  *   smbus   - kernel SMBus calls on /dev/i2c-N (the default)
+  *   rdwr    - kernel I2C_RDWR ioctls on /dev/i2c-N, which can read
+  *             every chip in a sweep with a single ioctl
+  *   bcm2835 - libbcm2835 on the Raspberry Pi, if built WITH_BCM2835.
+  *             This replaces the old adt74x0b program. The path
+  *             argument can set the clock, or with baud=auto let it
+  *             find the fastest one the wiring allows (see i2c_bcm2835.c)
+  *   mock    - pretend chips for testing without hardware, configured
+  *             by the path argument (see i2c_mock.c)
+  *
+  * The kernel backends work on the Raspberry Pi but the I2C
   * bus doesn't play well with the chips. I think it's this issue:
   *   http://www.raspberrypi.org/phpBB3/viewtopic.php?f=44&t=15840
   *
@@ -13,6 +113,7 @@
   * the chips really are ADT74x0s, which isn't the end-of-the-world.
   * However, if you're running this on a saner bus, define 
   * GOOD_I2C_BUS for more checks (notably that the ID code is 0b11001xxx).
+  * The bcm2835 backend always does these checks.
   *
   * ADT data can be found at:
   *   http://www.analog.com/en/mems-sensors/digital-temperature-sensors/adt7410/products/product.html
@@ -42,125 +143,756 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <unistd.h>
-#include <fcntl.h>
 #include <stdlib.h>
-#include <sys/ioctl.h>
-#include <linux/i2c-dev.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "adt74x0.h"
+#include "adt74x0_dev.h"
+#include "adt74x0_gpio.h"
+#include "adt74x0_out.h"
+#include "adt74x0_probe.h"
+#include "adt74x0_ring.h"
+
+/* A 16-bit conversion takes 240ms, so poll STATUS every
+   10ms, 20ms, 40ms, 40ms, ... and give up after a second */
+#define POLL_MIN_US      10000
+#define POLL_MAX_US      40000
+#define READY_TIMEOUT_US 1000000
+
+/* While a GPIO line's held low, look at STATUS this often */
+#define WATCH_POLL_MS    250
+
+/* Each bus is looked after by its own thread */
+struct bus_worker
+{
+  int            index;
+  const char    *path;
+  struct i2c_bus bus;
+  pthread_t      thread;
+
+  // Handles on just the chips which initialized, packed together so
+  // sweeps don't wade through empty addresses: see adt74x0_dev.h
+  struct adt74x0_dev devs[I2C_ADDRS];
+  int                n_devs;
+
+  // INT and CT, if we're waiting for them
+  struct gpio_lines gpio;
+
+  // Readings on their way to the output thread
+  struct ring ring;
+};
 
-/* I2C registers in ADT74x0 */
-#define T_MSB  0x00
-#define T_LSB  0x01
-#define STATUS 0x02
-#define CONFIG 0x03
-#define IDREG  0x0b
-#define RESET  0x2f
+#define MAX_BUSES 32
 
-#define I2C_ADDRS 128
+static struct bus_worker workers[MAX_BUSES];
+static int n_workers = 0;
 
-static int init_adt74x0(const int file, const int addr);
-static int read_adt74x0(const int file, const int addr, double *temp);
+static struct output out = { .format = OUT_TEXT };
 
+// Posted whenever there's something for the output thread to do
+static sem_t out_wake;
 
+// Set when all the bus threads have finished
+static int sampling_done = 0;
 
-int main(int argc, const char *argv[])
+// interval <= 0 means read once and exit
+static double interval = 0.0;
+
+// CLOCK_MONOTONIC: sweeps happen at start + k * interval
+static struct timespec start;
+
+// What to write to CONFIG
+static uint8_t config = CONFIG_16BIT | CONFIG_CTS;
+
+// Don't reset chips which are already set up
+static int warm = 0;
+
+// Give each chip its own slot in the interval
+static int stagger = 0;
+
+// Limits to write to the chips, if have_limits
+static struct adt74x0_limits limits;
+static int have_limits = 0;
+
+// GPIO lines to wait on, for each bus in turn
+static const char *gpio_specs[MAX_BUSES];
+static int n_gpio_specs = 0;
+
+// Where to look for chips, and where to remember them
+static const char *ranges = PROBE_DEFAULT;
+static uint8_t     want[I2C_ADDRS];
+static const char *cache = NULL;
+
+static int64_t mono_ns(void);
+static void sleep_until(const int64_t ns);
+static void *run_bus(void *arg);
+static int init_devs(struct bus_worker *w, const uint8_t *addrs, const int n);
+static void close_devs(struct bus_worker *w);
+static void *run_output(void *arg);
+static void first_sweep(struct bus_worker *w);
+static void sweep(struct bus_worker *w);
+static void staggered(struct bus_worker *w, const int64_t t0, const int64_t period);
+static void watch(struct bus_worker *w, const int64_t t0, const int64_t period);
+static void alarms(struct bus_worker *w);
+static int parse_limits(const char *s, struct adt74x0_limits *l);
+static void report(struct bus_worker *w, const struct adt74x0_dev *d, const int stat);
+static void fail(struct bus_worker *w, struct adt74x0_dev *d, const int stat);
+
+
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-a ranges] [-b backend] [-c cache] [-e gpios] [-f format]"
+	  " [-i interval] [-l limits] [-m mode] [-p pin] [-r 13|16] [-s] [-t clock] [-w]"
+	  " [/dev/i2c-N ...]\n", prog);
+  fprintf(stderr, "  backends: ");
+  i2c_bus_list(stderr);
+  fprintf(stderr, "\n  formats: text, binary\n  modes: cts, 1sps, oneshot\n"
+	  "  clocks: mono, real\n  ranges: e.g. %s\n"
+	  "  gpios: e.g. /dev/gpiochip0:17,27\n  limits: low:high[:crit[:hyst]]\n"
+	  "  pins: interrupt, comparator\n",
+	  PROBE_DEFAULT);
+  exit(1);
+}
+
+int main(int argc, char *argv[])
 {
   const char default_file[] = "/dev/i2c-0";
-  const char *filename = (argc > 1) ? argv[1] : default_file;
 
-  printf("# Scanning %s for ADT74x0...\n", filename);
+  const struct i2c_bus_ops *ops = &i2c_smbus_ops;
 
-  int file = open(filename,O_RDWR);
-  if (file < 0) {
-    printf("Unable to open %s\n", filename);
-    exit(1);
-  }
+  int format, clock;
+
+  int opt;
+  while((opt = getopt(argc, argv, "a:b:c:e:f:i:l:m:p:r:st:w")) != -1)
+    {
+      switch(opt)
+	{
+	case 'a':
+	  ranges = optarg;
+	  break;
+	case 'b':
+	  ops = i2c_bus_lookup(optarg);
+	  if (!ops)
+	    usage(argv[0]);
+	  break;
+	case 'c':
+	  cache = optarg;
+	  break;
+	case 'e':
+	  if (n_gpio_specs == MAX_BUSES)
+	    usage(argv[0]);
+	  gpio_specs[n_gpio_specs++] = optarg;
+	  break;
+	case 'f':
+	  format = out_format_lookup(optarg);
+	  if (format < 0)
+	    usage(argv[0]);
+	  out.format = format;
+	  break;
+	case 'i':
+	  // It becomes a period in ns, which mustn't round to 0 or overflow
+	  interval = atof(optarg);
+	  if (!isfinite(interval) || interval * 1e9 < 1.0
+	      || interval * 1e9 > INT64_MAX / 2)
+	    usage(argv[0]);
+	  break;
+	case 'l':
+	  if (parse_limits(optarg, &limits) < 0)
+	    usage(argv[0]);
+	  have_limits = 1;
+	  break;
+	case 'm':
+	  config &= ~CONFIG_MODE;
+	  if      (strcmp(optarg, "cts")     == 0) config |= CONFIG_CTS;
+	  else if (strcmp(optarg, "1sps")    == 0) config |= CONFIG_1SPS;
+	  else if (strcmp(optarg, "oneshot") == 0) config |= CONFIG_ONE_SHOT;
+	  else usage(argv[0]);
+	  break;
+	case 'p':
+	  if      (strcmp(optarg, "interrupt")  == 0) config &= ~CONFIG_COMP;
+	  else if (strcmp(optarg, "comparator") == 0) config |=  CONFIG_COMP;
+	  else usage(argv[0]);
+	  break;
+	case 'r':
+	  if      (strcmp(optarg, "16") == 0) config |=  CONFIG_16BIT;
+	  else if (strcmp(optarg, "13") == 0) config &= ~CONFIG_16BIT;
+	  else usage(argv[0]);
+	  break;
+	case 's':
+	  stagger = 1;
+	  break;
+	case 't':
+	  clock = out_clock_lookup(optarg);
+	  if (clock < 0)
+	    usage(argv[0]);
+	  out.clock = clock;
+	  break;
+	case 'w':
+	  warm = 1;
+	  break;
+	default:
+	  usage(argv[0]);
+	}
+    }
+
+  const int n_paths = (optind < argc) ? argc - optind : 1;
+  if (n_paths > MAX_BUSES || (ops->one_bus && n_paths > 1))
+    usage(argv[0]);
+
+  const int stat = probe_parse(ranges, ops->good_bus, want);
+  if (stat == -2)
+    {
+      fprintf(stderr, "%s can't check IDREG, so only %s can be probed\n",
+	      ops->name, PROBE_DEFAULT);
+      exit(1);
+    }
+  if (stat < 0)
+    usage(argv[0]);
+
+  if (n_gpio_specs > 0 && n_gpio_specs != n_paths)
+    usage(argv[0]);
+
+  if (cache && topo_load(cache) < 0)
+    fprintf(stderr, "Unable to read %s\n", cache);
 
-  // Keep track of the status of all I2C devices:
-  //    +ve good, 0 ignorable, -ve bad
-  int8_t devs[I2C_ADDRS];
-  for(int i = 0; i < I2C_ADDRS; i++)
-    devs[i] = (i >= 0x48 && i <= 0x4b) ? 1 : 0;
+  out.f = stdout;
+  out.multi_bus = n_paths > 1;
 
-  // Initialize chips & start conversions
-  for(int i = 0; i < I2C_ADDRS; i++)
+  for(int i = 0; i < n_paths; i++)
     {
-      if (devs[i] <= 0)
+      struct bus_worker *w = &workers[n_workers];
+
+      w->index   = i;
+      w->path    = (optind < argc) ? argv[optind + i] : default_file;
+      w->bus.ops = ops;
+
+      if (out.format == OUT_TEXT)
+	printf("# Scanning %s (%s) for ADT74x0...\n", w->path, ops->name);
+
+      if (ops->open(&w->bus, w->path) < 0) {
+	fprintf(stderr, "Unable to open %s\n", w->path);
 	continue;
+      }
 
-      int stat = init_adt74x0(file, i);
-      if (stat < 0)
-	devs[i] = stat;
+      w->gpio.line_fd = -1;
+      if (n_gpio_specs > 0 && gpio_open(&w->gpio, gpio_specs[i]) < 0)
+	{
+	  fprintf(stderr, "Unable to watch %s\n", gpio_specs[i]);
+	  ops->close(&w->bus);
+	  continue;
+	}
+
+      n_workers++;
     }
 
-  // Allow 1s for chips to read the temperature
-  usleep(1000000);
+  if (n_workers == 0)
+    exit(1);
+
+  out_begin(&out);
 
-  // Get results
-  for(int i = 0; i < I2C_ADDRS; i++)
+  sem_init(&out_wake, 0, 0);
+
+  pthread_t output_thread;
+  if (pthread_create(&output_thread, NULL, run_output, NULL) != 0)
     {
-      if (devs[i] <= 0)
-	continue;
+      fprintf(stderr, "Unable to start output thread\n");
+      exit(1);
+    }
 
-      double t;
-      int stat = read_adt74x0(file, i, &t);
+  clock_gettime(CLOCK_MONOTONIC, &start);
 
-      if (stat < 0) { printf("# 0x%02x error %d\n", i, stat); }
-      else          { printf("0x%02x %.5fC\n", i, t);         }
+  // Buses are independent, so a sweep only takes as long as the slowest
+  for(int i = 0; i < n_workers; i++)
+    if (pthread_create(&workers[i].thread, NULL, run_bus, &workers[i]) != 0)
+      {
+	fprintf(stderr, "Unable to start thread for %s\n", workers[i].path);
+	exit(1);
+      }
+
+  for(int i = 0; i < n_workers; i++)
+    {
+      pthread_join(workers[i].thread, NULL);
+      close_devs(&workers[i]);
+      workers[i].bus.ops->close(&workers[i].bus);
+      if (workers[i].gpio.line_fd >= 0)
+	gpio_close(&workers[i].gpio);
     }
 
-  close(file);
+  // Let the output thread empty the rings and finish
+  __atomic_store_n(&sampling_done, 1, __ATOMIC_RELEASE);
+  sem_post(&out_wake);
+  pthread_join(output_thread, NULL);
   
   return 0;
 }
 
-// Return 0 if OK, -ve to show error
-static int init_adt74x0(const int file, const int addr)
+static void *run_bus(void *arg)
 {
-  if (ioctl(file,I2C_SLAVE,addr) < 0)
-    return -1;
+  struct bus_worker *w = arg;
 
-  if (i2c_smbus_write_byte(file, RESET) < 0)
-    return -2;
+  const char *backend = w->bus.ops->name;
 
-  usleep(250); // Device needs 200us after reset
-  
-#ifdef GOOD_I2C_BUS
-  // This call fails on e.g. the Raspberry Pi
-  // presumably because of some oddity with their i2c hardware
-  // see the preamble at the top of the file for more.
-  int stat = i2c_smbus_read_byte_data(file, IDREG);  
-  if (stat < 0)
-    return -3;
+  // Find the chips, from the cache if we can
+  uint8_t addrs[I2C_ADDRS];
+  int n = cache ? topo_lookup(backend, w->path, ranges, addrs) : -1;
+
+  const int cached = n >= 0;
+  if (!cached)
+    n = probe_bus(&w->bus, want, addrs);
+
+  // Initialize chips & start conversions. If one from the cache
+  // doesn't work, something's changed so look again.
+  if (init_devs(w, addrs, n) < n && cached)
+    {
+      close_devs(w);
+      n = probe_bus(&w->bus, want, addrs);
+      init_devs(w, addrs, n);
+    }
+
+  // Only remember the chips which work, or one which answers the probe
+  // but can't be set up would have us probing afresh every start
+  for(int i = 0; i < w->n_devs; i++)
+    addrs[i] = w->devs[i].addr;
+
+  if (cache && topo_store(cache, backend, w->path, ranges, addrs, w->n_devs) < 0)
+    fprintf(stderr, "Unable to write %s\n", cache);
+
+  if (have_limits)
+    for(int i = 0; i < w->n_devs; i++)
+      {
+	const int stat = limits_dev(&w->devs[i], &limits);
+	if (stat < 0)
+	  fail(w, &w->devs[i], stat);
+      }
+
+  // Get results as soon as the chips have them
+  first_sweep(w);
+
+  // and then repeatedly if asked
+  const int64_t period = (int64_t)(interval * 1e9);
+  const int64_t t0     = (int64_t)start.tv_sec * 1000000000 + start.tv_nsec;
+  int64_t       k      = 0;
+
+  if (w->gpio.line_fd >= 0)
+    {
+      watch(w, t0, period);
+      return NULL;
+    }
+
+  if (interval > 0.0 && stagger && w->n_devs > 0)
+    staggered(w, t0, period);
+
+  while(interval > 0.0)
+    {
+      // Next deadline in the future: if we've overrun, skip the ones
+      // we missed rather than rushing to catch up
+      const int64_t now = mono_ns();
+      if (t0 + k * period <= now)
+	k = (now - t0) / period + 1;
+
+      sleep_until(t0 + k * period);
+      sweep(w);
+    }
 
-  printf("# 0x%02x has ID 0x%02x\n", addr, stat);
-  if ((stat & 0xf8) != 0xc8)
-    return -4;
+  return NULL;
+}
+
+// Open and init_dev each chip, keeping those which work. Return how
+// many do. Every chip is reset before any is set up, so however many
+// there are they only wait for RESET_US once between them.
+static int init_devs(struct bus_worker *w, const uint8_t *addrs, const int n)
+{
+  struct adt74x0_dev *devs = &w->devs[w->n_devs];
+  int stats[I2C_ADDRS];
+  int n_reset = 0;
+
+  for(int i = 0; i < n; i++)
+    {
+      stats[i] = open_dev(&devs[i], &w->bus, w->path, addrs[i]);
+      if (stats[i] == 0)
+	{
+	  stats[i] = start_init_dev(&devs[i], config, warm);
+	  n_reset += stats[i] == 0;
+	}
+      else
+	devs[i].bus = NULL;
+    }
+
+  if (n_reset > 0)
+    usleep(RESET_US);
+
+  // Set up the ones which were reset, and pack the survivors
+  const int n0 = w->n_devs;
+  for(int i = 0; i < n; i++)
+    {
+      if (stats[i] == 0)
+	stats[i] = finish_init_dev(&devs[i]);
+
+      if (stats[i] >= 0)
+	move_dev(&w->devs[w->n_devs++], &devs[i]);
+      else if (devs[i].bus)
+	close_dev(&devs[i]);
+#ifdef DEBUG
+      printf("# init(bus = %d, addr = %02x) = %d\n", w->index, addrs[i], stats[i]);
 #endif
+    }
+
+  return w->n_devs - n0;
+}
 
-  if (i2c_smbus_write_byte_data(file, CONFIG, 0x80) < 0) // 16bit cts conversions
-    return -5;
+static void close_devs(struct bus_worker *w)
+{
+  for(int i = 0; i < w->n_devs; i++)
+    close_dev(&w->devs[i]);
 
-  return 0;
-}  
+  w->n_devs = 0;
+}
 
-// Return 0 if OK, -ve to show error
-// Set *temp to be the temperature in Celsius
-static int read_adt74x0(const int file, const int addr, double *temp)
+static int64_t mono_ns(void)
 {
-  if (ioctl(file,I2C_SLAVE,addr) < 0)
-    return -1;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-  int32_t t_raw  = i2c_smbus_read_word_data(file, T_MSB);
-  if (t_raw < 0)
-    return -6;
- 
-  // ADT74x0 puts MSB first so flip order
-  int16_t lo = (t_raw & 0xff00) >> 8;
-  int16_t hi = (t_raw & 0x00ff);
+static void sleep_until(const int64_t ns)
+{
+  struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+    ;
+}
+
+// Read each chip as soon as its STATUS says the first conversion is
+// done. Chips which never say so (e.g. because reading STATUS fails on
+// a dodgy bus) get read anyway when READY_TIMEOUT_US has passed.
+// Warm chips have a reading already, so don't wait for them.
+static void first_sweep(struct bus_worker *w)
+{
+  int8_t pending[I2C_ADDRS];
+  int n_pending = 0;
+  for(int i = 0; i < w->n_devs; i++)
+    {
+      struct adt74x0_dev *d = &w->devs[i];
+
+      pending[i] = !d->warm;
+      n_pending += pending[i];
+
+      if (d->warm)
+	{
+	  report(w, d, read_dev(d));
+	  d->warm = 0;
+	}
+    }
+
+  useconds_t waited = 0;
+  useconds_t poll   = POLL_MIN_US;
+  
+  while(n_pending > 0)
+    {
+      usleep(poll);
+      waited += poll;
+
+      const int timed_out = waited >= READY_TIMEOUT_US;
+
+      for(int i = 0; i < w->n_devs; i++)
+	{
+	  if (!pending[i])
+	    continue;
+
+	  struct adt74x0_dev *d = &w->devs[i];
+
+	  if (!timed_out && ready_dev(d) <= 0)
+	    continue;
+
+	  report(w, d, read_dev(d));
+
+	  pending[i] = 0;
+	  n_pending--;
+	}
+
+      poll = (2 * poll > POLL_MAX_US) ? POLL_MAX_US : 2 * poll;
+    }
+}
+
+// Read all the chips at once if the backend allows it, so that with
+// rdwr a whole sweep is a single ioctl. In one-shot mode, first start
+// a conversion on every chip and wait for them.
+static void sweep(struct bus_worker *w)
+{
+  struct adt74x0_dev *devs[I2C_ADDRS];
+  int n = 0;
+
+  const int one_shot = (config & CONFIG_MODE) == CONFIG_ONE_SHOT;
+  
+  for(int i = 0; i < w->n_devs; i++)
+    {
+      struct adt74x0_dev *d = &w->devs[i];
+
+      if (!due_dev(d))
+	continue;
+
+      if (one_shot)
+	{
+	  int stat = trigger_dev(d);
+	  if (stat < 0)
+	    {
+	      fail(w, d, stat);
+	      continue;
+	    }
+	}
+
+      devs[n++] = d;
+    }
+
+  if (one_shot && n > 0)
+    sleep_until(mono_ns() + CONVERSION_US * 1000LL);
+
+  int stats[I2C_ADDRS];
+  read_many_dev(&w->bus, devs, n, stats);
+
+  for(int i = 0; i < n; i++)
+    report(w, devs[i], stats[i]);
+}
+
+// Like calling sweep() every period, but with chip i read at offset
+// i * period / n into each, and in one-shot mode triggered
+// CONVERSION_US before that. Never returns.
+static void staggered(struct bus_worker *w, const int64_t t0, const int64_t period)
+{
+  const int n        = w->n_devs;
+  const int one_shot = (config & CONFIG_MODE) == CONFIG_ONE_SHOT;
+  const int64_t conv = one_shot ? CONVERSION_US * 1000LL : 0;
+
+  // Each chip's next slot, and in one-shot mode whether it's
+  // been triggered for it (so what's next is the read)
+  int64_t slot[I2C_ADDRS];
+  int8_t  triggered[I2C_ADDRS];
+
+  const int64_t first = mono_ns() + conv;
+  for(int i = 0; i < n; i++)
+    {
+      slot[i] = t0 + i * period / n;
+      while(slot[i] < first)
+	slot[i] += period;
+      triggered[i] = !one_shot;
+    }
+
+  for(;;)
+    {
+      // Whoever's next: there aren't many chips, so just look
+      int next = 0;
+      for(int i = 1; i < n; i++)
+	if (slot[i] - (triggered[i] ? 0 : conv) < slot[next] - (triggered[next] ? 0 : conv))
+	  next = i;
+
+      struct adt74x0_dev *d = &w->devs[next];
+
+      sleep_until(slot[next] - (triggered[next] ? 0 : conv));
+
+      int stat = 0;
+      if (!triggered[next])
+	{
+	  if (due_dev(d) && (stat = trigger_dev(d)) == 0)
+	    {
+	      // Wait the whole conversion from now, even if we're late
+	      const int64_t ready = mono_ns() + conv;
+	      if (slot[next] < ready)
+		slot[next] = ready;
+
+	      triggered[next] = 1;
+	      continue;
+	    }
+
+	  if (stat < 0)
+	    fail(w, d, stat);
+	}
+      else if (one_shot || due_dev(d))
+	report(w, d, read_dev(d));
+
+      // On to the next slot in the future, skipping any we've missed
+      triggered[next] = !one_shot;
+
+      const int64_t now = mono_ns() + (one_shot ? conv : 0);
+      do
+	slot[next] += period;
+      while(slot[next] <= now);
+    }
+}
+
+// Wait for INT or CT, and then read any chip which STATUS says has
+// passed a limit. With -i, sweep every period too.
+static void watch(struct bus_worker *w, const int64_t t0, const int64_t period)
+{
+  int64_t k    = 0;
+  int     held = 0;   // a line was still low after the last look
+
+  for(;;)
+    {
+      int     timeout_ms = held ? WATCH_POLL_MS : -1;
+      int64_t deadline   = 0;
+
+      if (period > 0)
+	{
+	  const int64_t now = mono_ns();
+	  if (t0 + k * period <= now)
+	    k = (now - t0) / period + 1;
+
+	  deadline = t0 + k * period;
 
-  int16_t t128 = hi << 8 | lo;
+	  const int ms = (deadline - now + 999999) / 1000000;
+	  if (timeout_ms < 0 || ms < timeout_ms)
+	    timeout_ms = ms;
+	}
+
+      const int stat = gpio_wait(&w->gpio, timeout_ms);
+      if (stat < 0)
+	{
+	  fprintf(stderr, "Unable to wait for %s: error %d\n", gpio_specs[w->index], stat);
+	  return;
+	}
+
+      if (stat > 0)
+	alarms(w);
+      else if (period > 0 && mono_ns() >= deadline)
+	sweep(w);
+      else if (held)
+	alarms(w);
+
+      // A pin in comparator mode holding a shared line low means no
+      // edge from the others on it, so keep looking until it lets go
+      held = gpio_low(&w->gpio);
+      if (held < 0)
+	{
+	  fprintf(stderr, "Unable to read %s: error %d\n", gpio_specs[w->index], held);
+	  return;
+	}
+    }
+}
 
-  *temp = t128 / 128.0;
+// Reading STATUS also lets go of INT in interrupt mode
+static void alarms(struct bus_worker *w)
+{
+  for(int i = 0; i < w->n_devs; i++)
+    {
+      struct adt74x0_dev *d = &w->devs[i];
+
+      const int status = status_dev(d);
+      if (status < 0)
+	fail(w, d, status);
+      else if (status & STATUS_ALARMS)
+	{
+	  // Reading STATUS may have cleared the flags, so keep these
+	  const int stat = read_dev(d);
+	  d->alarms |= status & STATUS_ALARMS;
+	  report(w, d, stat);
+	}
+    }
+}
+
+// low:high[:crit[:hyst]] in C
+static int parse_limits(const char *s, struct adt74x0_limits *l)
+{
+  double   t[3] = { 10.0, 64.0, 147.0 };
+  unsigned hyst = 5;
+
+  const int n = sscanf(s, "%lf:%lf:%lf:%u", &t[0], &t[1], &t[2], &hyst);
+  if (n < 2 || t[0] >= t[1] || hyst > 15)
+    return -1;
+
+  int16_t t128[3];
+  for(int i = 0; i < 3; i++)
+    {
+      if (t[i] < -55.0 || t[i] > 150.0)
+	return -1;
+      t128[i] = (int16_t)(t[i] * T128_PER_C + ((t[i] < 0) ? -0.5 : 0.5));
+    }
 
+  l->t_low  = t128[0];
+  l->t_high = t128[1];
+  l->t_crit = t128[2];
+  l->t_hyst = hyst;
   return 0;
 }
+
+// Write everything in the rings, flushing after each batch so
+// whoever's reading the pipe sees each sweep promptly
+static void *run_output(void *arg)
+{
+  (void)arg;
+
+  unsigned long dropped[MAX_BUSES] = { 0 };
+
+  for(;;)
+    {
+      while(sem_wait(&out_wake) != 0)
+	;
+
+      const int done = __atomic_load_n(&sampling_done, __ATOMIC_ACQUIRE);
+
+      for(int i = 0; i < n_workers; i++)
+	{
+	  struct sample s;
+	  while(ring_pop(&workers[i].ring, &s))
+	    out_sample(&out, &s);
+
+	  const unsigned long n = ring_overflows(&workers[i].ring);
+	  if (n != dropped[i])
+	    {
+	      fprintf((out.format == OUT_TEXT) ? out.f : stderr,
+		      "# bus %d dropped %lu readings\n", workers[i].index,
+		      n - dropped[i]);
+	      dropped[i] = n;
+	    }
+	}
+
+      fflush(out.f);
+
+      if (done)
+	return NULL;
+    }
+}
+
+// The chip's latest reading, or stat if that failed.
+// Never blocks: see adt74x0_ring.h
+static void report(struct bus_worker *w, const struct adt74x0_dev *d, const int stat)
+{
+  const struct xfer_time *when = &d->when;
+
+  struct sample s =
+    {
+      .mono_ns = when->mid_ns,
+      .addr    = d->addr,
+      .bus     = w->index,
+      .t128    = (stat < 0) ? 0 : d->t128,
+      .stat    = stat,
+      .xfer_us = (when->len_ns > 65535000) ? 65535 : when->len_ns / 1000,
+      .alarms  = (stat < 0) ? 0 : d->alarms,
+    };
+
+  if (out.clock == OUT_REAL)
+    {
+      // Translate to CLOCK_REALTIME: both clocks tick at the same rate
+      struct timespec mono, real;
+      clock_gettime(CLOCK_MONOTONIC, &mono);
+      clock_gettime(CLOCK_REALTIME,  &real);
+
+      s.real_ns = (int64_t)real.tv_sec * 1000000000 + real.tv_nsec
+	- ((int64_t)mono.tv_sec * 1000000000 + mono.tv_nsec - s.mono_ns);
+    }
+
+  ring_push(&w->ring, &s);
+  sem_post(&out_wake);
+}
+
+// Report an error from something other than a read, timed now
+static void fail(struct bus_worker *w, struct adt74x0_dev *d, const int stat)
+{
+  d->when = (struct xfer_time){ mono_ns(), 0 };
+  report(w, d, stat);
+}
@@ -0,0 +1,130 @@
+/*
+ * Talking to ADT7410 and ADT7420 I2C temperature sensors
+ * over any of the backends in i2c_bus.h.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#ifndef ADT74X0_H
+#define ADT74X0_H
+
+#include <stdint.h>
+
+#include "i2c_bus.h"
+
+/* I2C registers in ADT74x0 */
+#define T_MSB  0x00
+#define T_LSB  0x01
+#define STATUS 0x02
+#define CONFIG 0x03
+#define T_HIGH 0x04   // 16 bit, like the temperature
+#define T_LOW  0x06
+#define T_CRIT 0x08
+#define T_HYST 0x0a   // 0 to 15C
+#define IDREG  0x0b
+#define RESET  0x2f
+
+/* STATUS bit which goes low when a new conversion is ready */
+#define STATUS_NRDY 0x80
+
+/* and those which say a limit's been passed */
+#define STATUS_T_CRIT 0x40
+#define STATUS_T_HIGH 0x20
+#define STATUS_T_LOW  0x10
+#define STATUS_ALARMS 0x70
+
+/* CONFIG bits */
+#define CONFIG_16BIT    0x80  // else 13 bit
+#define CONFIG_MODE     0x60  // mask for the operation mode...
+#define CONFIG_CTS      0x00  // continuous conversions
+#define CONFIG_ONE_SHOT 0x20  // one conversion then shutdown
+#define CONFIG_1SPS     0x40  // a conversion every second
+#define CONFIG_SHUTDOWN 0x60
+#define CONFIG_COMP     0x10  // INT in comparator mode, else interrupt
+
+/* How long a one-shot or continuous conversion takes */
+#define CONVERSION_US 240000
+
+/* The chip needs 200us after RESET */
+#define RESET_US 250
+
+#define I2C_ADDRS 128
+
+/* Temperatures are kept as the chip gives them, in units of 1/128C,
+   and only turned into text by format_adt74x0. In 13 bit mode the
+   resolution is only 1/16C and the bottom 3 bits are threshold flags,
+   which are cleared so readings are still in 1/128C. */
+#define T128_PER_C 128
+#define T13_FLAGS  0x07
+
+/* Longest string format_adt74x0 makes, with the '\0' */
+#define FORMAT_ADT74X0_LEN 12
+
+/* What to compare each conversion with, which drives the INT and CT
+   pins and the STATUS flags. Temperatures are in 1/128C, t_hyst in C */
+struct adt74x0_limits
+{
+  int16_t t_high;
+  int16_t t_low;
+  int16_t t_crit;
+  uint8_t t_hyst;
+};
+
+/* When a reading was taken, by CLOCK_MONOTONIC */
+struct xfer_time
+{
+  int64_t mid_ns;   // half way through the bus transaction
+  int32_t len_ns;   // how long the transaction took
+};
+
+// All return 0 if OK (or as noted), -ve to show error
+
+// See if there's an ADT74x0 at addr without changing anything: by
+// IDREG if the bus is good enough, else just that T_MSB can be read
+int probe_adt74x0(struct i2c_bus *bus, const uint8_t addr);
+
+// Reset the chip, usleep(RESET_US), then setup_adt74x0 it to write
+// config (e.g. CONFIG_16BIT | CONFIG_CTS) to CONFIG, which starts
+// conversions unless it's CONFIG_SHUTDOWN. Apart, several chips can
+// be reset and share the one wait.
+int reset_adt74x0(struct i2c_bus *bus, const uint8_t addr);
+int setup_adt74x0(struct i2c_bus *bus, const uint8_t addr, const uint8_t config);
+
+// 1 if the chip's CONFIG already says config and it's converting by
+// itself, so it can be left alone: there's a reading there now. Else
+// (or if CONFIG can't be read) 0, and it needs resetting.
+int warm_adt74x0(struct i2c_bus *bus, const uint8_t addr, const uint8_t config);
+
+// Start a single conversion: config should include CONFIG_ONE_SHOT
+int trigger_adt74x0(struct i2c_bus *bus, const uint8_t addr, const uint8_t config);
+
+// Return 1 if a conversion is ready, 0 if not
+int ready_adt74x0(struct i2c_bus *bus, const uint8_t addr);
+
+// Return STATUS, e.g. to see which of STATUS_ALARMS are set
+int status_adt74x0(struct i2c_bus *bus, const uint8_t addr);
+
+// Write all of the limits
+int limits_adt74x0(struct i2c_bus *bus, const uint8_t addr,
+		   const struct adt74x0_limits *limits);
+
+// Set *t128 to be the temperature in 1/128 C, and if when isn't NULL
+// note the time. config is what was written to CONFIG. If alarms isn't
+// NULL set it to the STATUS_ALARMS the reading came with, which is
+// only known in 13 bit mode: in 16 bit mode it's 0, so read STATUS.
+int read_adt74x0(struct i2c_bus *bus, const uint8_t addr, const uint8_t config,
+		 int16_t *t128, uint8_t *alarms, struct xfer_time *when);
+
+// read_adt74x0 for each of n chips, in one bus transaction if the
+// backend can, setting stats[i] to what read_adt74x0 would return.
+// alarms and whens may be NULL.
+void read_many_adt74x0(struct i2c_bus *bus, const uint8_t *addrs, const int n,
+		       const uint8_t config, int16_t *t128s, int *stats,
+		       uint8_t *alarms, struct xfer_time *whens);
+
+// Write t128 as Celsius to 5 decimal places, e.g. "23.12500", just as
+// printf("%.5f", t128 / 128.0) would but without any floating point.
+// Return the length.
+int format_adt74x0(char *buf, const int16_t t128);
+
+#endif
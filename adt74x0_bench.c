@@ -0,0 +1,288 @@
+/*
+ * Time the ADT74x0 sample path.
+ *
+ * usage: adt74x0_bench [-n iterations] [backend[:path]] ...
+ *
+ * For each backend, time init_dev(), ready_dev() and read_dev() per
+ * chip, and whole sweeps of every chip with read_many_dev(), and
+ * turning readings into text with format_adt74x0(). That's through
+ * the same per chip handles as adt74x0 uses, so e.g. with smbus each
+ * chip has its own fd. Each is reported as latency percentiles, the
+ * number of syscalls (or bus transactions) per sample, and the
+ * number of calls (so for sweeps, sweeps) per second.
+ *
+ * With no backends given, use the mock bus, and the kernel backends
+ * on /dev/i2c-0 if it can be opened.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "adt74x0.h"
+#include "adt74x0_dev.h"
+
+// init includes a reset and takes a while, so don't do it as much
+#define INIT_ITERATIONS 100
+
+struct timing
+{
+  int64_t      *ns;
+  int           n;
+  int           samples;   // per call
+  unsigned long xfers;
+};
+
+static void bench(const char *spec, const int iterations);
+static unsigned long xfers(const struct i2c_bus *bus, const struct adt74x0_dev *devs,
+			   const int n);
+static void report(const char *backend, const char *op, struct timing *t);
+
+
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-n iterations] [backend[:path]] ...\n", prog);
+  fprintf(stderr, "  backends: ");
+  i2c_bus_list(stderr);
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  int iterations = 1000;
+
+  int opt;
+  while((opt = getopt(argc, argv, "n:")) != -1)
+    {
+      switch(opt)
+	{
+	case 'n':
+	  iterations = atoi(optarg);
+	  if (iterations <= 0)
+	    usage(argv[0]);
+	  break;
+	default:
+	  usage(argv[0]);
+	}
+    }
+
+  printf("%-20s %-6s %7s %9s %9s %9s %9s %12s %9s\n",
+	 "# backend", "op", "calls", "p50/us", "p90/us", "p99/us", "max/us",
+	 "xfers/sample", "calls/s");
+
+  if (optind < argc)
+    {
+      for(int i = optind; i < argc; i++)
+	bench(argv[i], iterations);
+      return 0;
+    }
+
+  bench("mock", iterations);
+
+  // Only try real hardware if it's there
+  int file = open("/dev/i2c-0", O_RDWR);
+  if (file >= 0)
+    {
+      close(file);
+      bench("smbus:/dev/i2c-0", iterations);
+      bench("rdwr:/dev/i2c-0",  iterations);
+    }
+
+  return 0;
+}
+
+static int64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void bench(const char *spec, const int iterations)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "%s", spec);
+
+  char *path = strchr(name, ':');
+  if (path)
+    *path++ = '\0';
+
+  struct i2c_bus bus = { .ops = i2c_bus_lookup(name) };
+  if (!bus.ops)
+    {
+      printf("# %s: no such backend\n", name);
+      return;
+    }
+
+  if (bus.ops->open(&bus, path ? path : "") < 0)
+    {
+      printf("# %s: unable to open %s\n", name, path ? path : "");
+      return;
+    }
+
+  struct adt74x0_dev devs[4];
+  int8_t             found[4];
+  int                n = 0;
+
+  for(int i = 0; i < 4; i++)
+    if (open_dev(&devs[n], &bus, path ? path : "", 0x48 + i) == 0)
+      n++;
+
+  const int n_init = (iterations < INIT_ITERATIONS) ? iterations : INIT_ITERATIONS;
+  struct timing t = { .ns = malloc(sizeof(int64_t) * n_init * 4), .samples = 1 };
+
+  // init
+  for(int k = 0; k < n_init; k++)
+    for(int i = 0; i < n; i++)
+      {
+	unsigned long x0 = xfers(&bus, devs, n);
+	int64_t       t0 = now_ns();
+	int stat = init_dev(&devs[i], CONFIG_16BIT | CONFIG_CTS, 0);
+	t.ns[t.n++] = now_ns() - t0;
+	t.xfers += xfers(&bus, devs, n) - x0;
+
+	if (k == 0)
+	  found[i] = stat == 0;
+      }
+  report(spec, "init", &t);
+  free(t.ns);
+
+  // Keep just the chips which are there
+  const int n_open = n;
+  n = 0;
+  for(int i = 0; i < n_open; i++)
+    {
+      if (found[i])
+	move_dev(&devs[n++], &devs[i]);
+      else
+	close_dev(&devs[i]);
+    }
+
+  struct adt74x0_dev *ptrs[4];
+  for(int i = 0; i < n; i++)
+    ptrs[i] = &devs[i];
+
+  if (n == 0)
+    {
+      printf("# %s: no chips found\n", spec);
+      bus.ops->close(&bus);
+      return;
+    }
+
+  // Let the first conversion finish so reads aren't of nothing
+  struct timespec wait = { 0, 300000000 };
+  nanosleep(&wait, NULL);
+
+  // ready
+  t = (struct timing){ .ns = malloc(sizeof(int64_t) * iterations * n), .samples = 1 };
+  for(int k = 0; k < iterations; k++)
+    for(int i = 0; i < n; i++)
+      {
+	unsigned long x0 = xfers(&bus, devs, n);
+	int64_t       t0 = now_ns();
+	ready_dev(&devs[i]);
+	t.ns[t.n++] = now_ns() - t0;
+	t.xfers += xfers(&bus, devs, n) - x0;
+      }
+  report(spec, "ready", &t);
+
+  // read
+  t.n = 0;
+  t.xfers = 0;
+  for(int k = 0; k < iterations; k++)
+    for(int i = 0; i < n; i++)
+      {
+	unsigned long x0 = xfers(&bus, devs, n);
+	int64_t       t0 = now_ns();
+	read_dev(&devs[i]);
+	t.ns[t.n++] = now_ns() - t0;
+	t.xfers += xfers(&bus, devs, n) - x0;
+      }
+  report(spec, "read", &t);
+
+  // sweep
+  t.n = 0;
+  t.xfers = 0;
+  t.samples = n;
+  for(int k = 0; k < iterations; k++)
+    {
+      int stats[4];
+      unsigned long x0 = xfers(&bus, devs, n);
+      int64_t       t0 = now_ns();
+      read_many_dev(&bus, ptrs, n, stats);
+      t.ns[t.n++] = now_ns() - t0;
+      t.xfers += xfers(&bus, devs, n) - x0;
+    }
+  report(spec, "sweep", &t);
+
+  // format, which is all CPU so the backend doesn't matter
+  t.n = 0;
+  t.xfers = 0;
+  t.samples = 1;
+  for(int k = 0; k < iterations; k++)
+    {
+      char buf[FORMAT_ADT74X0_LEN];
+      int64_t t0 = now_ns();
+      format_adt74x0(buf, (int16_t)(k * 37));
+      t.ns[t.n++] = now_ns() - t0;
+    }
+  report(spec, "format", &t);
+  free(t.ns);
+
+  for(int i = 0; i < n; i++)
+    close_dev(&devs[i]);
+
+  bus.ops->close(&bus);
+}
+
+// Everything done on the bus, through the shared handle or the chips' own
+static unsigned long xfers(const struct i2c_bus *bus, const struct adt74x0_dev *devs,
+			   const int n)
+{
+  unsigned long x = bus->xfers;
+
+  for(int i = 0; i < n; i++)
+    if (devs[i].bus == &devs[i].own)
+      x += devs[i].own.xfers;
+
+  return x;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+  const int64_t x = *(const int64_t *)a;
+  const int64_t y = *(const int64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void report(const char *backend, const char *op, struct timing *t)
+{
+  if (t->n == 0)
+    return;
+
+  qsort(t->ns, t->n, sizeof(t->ns[0]), cmp_int64);
+
+  int64_t total = 0;
+  for(int i = 0; i < t->n; i++)
+    total += t->ns[i];
+
+#define PCTILE(p) (t->ns[(int)((t->n - 1) * (p))] / 1000.0)
+
+  printf("%-20s %-6s %7d %9.1f %9.1f %9.1f %9.1f %12.2f %9.0f\n",
+	 backend, op, t->n,
+	 PCTILE(0.5), PCTILE(0.9), PCTILE(0.99), PCTILE(1.0),
+	 (double)t->xfers / t->n / t->samples,
+	 t->n * 1e9 / total);
+
+#undef PCTILE
+}
@@ -0,0 +1,310 @@
+/*
+ * ADT74x0 register level code.
+ *
+ * Errors:
+ *   -1 selecting the slave
+ *   -2 sending RESET
+ *   -3 reading IDREG
+ *   -4 IDREG isn't 0b11001xxx
+ *   -5 writing CONFIG
+ *   -6 reading the temperature
+ *   -7 reading STATUS
+ *   -8 writing the limits
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <time.h>
+
+#include "adt74x0.h"
+
+int probe_adt74x0(struct i2c_bus *bus, const uint8_t addr)
+{
+  uint8_t buff[4];
+
+  if (bus->ops->set_addr(bus, addr) < 0)
+    return -1;
+
+  if (!bus->ops->good_bus)
+    return (bus->ops->read_reg(bus, T_MSB, buff, 2) < 0) ? -6 : 0;
+
+  if (bus->ops->read_reg(bus, IDREG, buff, 1) < 0)
+    return -3;
+
+  return ((buff[0] & 0xf8) != 0xc8) ? -4 : 0;
+}
+
+int reset_adt74x0(struct i2c_bus *bus, const uint8_t addr)
+{
+  uint8_t buff[4];
+
+  if (bus->ops->set_addr(bus, addr) < 0)
+    return -1;
+
+  buff[0] = RESET;
+  if (bus->ops->write(bus, buff, 1) < 0)
+    return -2;
+
+  return 0;
+}
+
+int setup_adt74x0(struct i2c_bus *bus, const uint8_t addr, const uint8_t config)
+{
+  uint8_t buff[4];
+
+  if (bus->ops->set_addr(bus, addr) < 0)
+    return -1;
+
+  // Reading IDREG fails with the kernel driver on e.g. the Raspberry Pi
+  // presumably because of some oddity with their i2c hardware
+  // see the preamble in adt74x0.c for more.
+  if (bus->ops->good_bus)
+    {
+      if (bus->ops->read_reg(bus, IDREG, buff, 1) < 0)
+	return -3;
+
+#ifdef DEBUG
+      printf("# 0x%02x has ID 0x%02x\n", addr, buff[0]);
+#endif
+      if ((buff[0] & 0xf8) != 0xc8)
+	return -4;
+    }
+
+  return trigger_adt74x0(bus, addr, config);
+}
+
+int warm_adt74x0(struct i2c_bus *bus, const uint8_t addr, const uint8_t config)
+{
+  uint8_t buff[4];
+
+  if (bus->ops->set_addr(bus, addr) < 0)
+    return -1;
+
+  // A one-shot chip will be shut down, so it needs a kick anyway
+  const uint8_t mode = config & CONFIG_MODE;
+  return (mode == CONFIG_CTS || mode == CONFIG_1SPS)
+    && bus->ops->read_reg(bus, CONFIG, buff, 1) == 0
+    && buff[0] == config;
+}
+
+int trigger_adt74x0(struct i2c_bus *bus, const uint8_t addr, const uint8_t config)
+{
+  uint8_t buff[4];
+
+  if (bus->ops->set_addr(bus, addr) < 0)
+    return -1;
+
+  buff[0] = CONFIG;
+  buff[1] = config;
+  if (bus->ops->write(bus, buff, 2) < 0)
+    return -5;
+
+  return 0;
+}
+
+int ready_adt74x0(struct i2c_bus *bus, const uint8_t addr)
+{
+  const int status = status_adt74x0(bus, addr);
+  if (status < 0)
+    return status;
+
+  return (status & STATUS_NRDY) ? 0 : 1;
+}
+
+int status_adt74x0(struct i2c_bus *bus, const uint8_t addr)
+{
+  uint8_t buff[4];
+
+  if (bus->ops->set_addr(bus, addr) < 0)
+    return -1;
+
+  if (bus->ops->read_reg(bus, STATUS, buff, 1) < 0)
+    return -7;
+
+  return buff[0];
+}
+
+int limits_adt74x0(struct i2c_bus *bus, const uint8_t addr,
+		   const struct adt74x0_limits *limits)
+{
+  const struct { uint8_t reg; int16_t t128; } words[] =
+    {
+      { T_HIGH, limits->t_high },
+      { T_LOW,  limits->t_low  },
+      { T_CRIT, limits->t_crit },
+    };
+
+  uint8_t buff[4];
+
+  if (bus->ops->set_addr(bus, addr) < 0)
+    return -1;
+
+  // MSB first, as they're read
+  for(int i = 0; i < 3; i++)
+    {
+      buff[0] = words[i].reg;
+      buff[1] = (uint16_t)words[i].t128 >> 8;
+      buff[2] = words[i].t128 & 0xff;
+      if (bus->ops->write(bus, buff, 3) < 0)
+	return -8;
+    }
+
+  buff[0] = T_HYST;
+  buff[1] = limits->t_hyst & 0x0f;
+  if (bus->ops->write(bus, buff, 2) < 0)
+    return -8;
+
+  return 0;
+}
+
+static int64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void set_when(struct xfer_time *when, const int64_t t0, const int64_t t1)
+{
+  if (!when)
+    return;
+
+  when->mid_ns = t0 + (t1 - t0) / 2;
+  when->len_ns = t1 - t0;
+}
+
+// The 13 bit flags as STATUS bits
+static uint8_t decode_alarms(const uint8_t *buff, const uint8_t config)
+{
+  if (config & CONFIG_16BIT)
+    return 0;
+
+  return ((buff[1] & 0x04) ? STATUS_T_CRIT : 0)
+    | ((buff[1] & 0x02) ? STATUS_T_HIGH : 0)
+    | ((buff[1] & 0x01) ? STATUS_T_LOW  : 0);
+}
+
+static int16_t decode_temp(const uint8_t *buff, const uint8_t config)
+{
+  // ADT74x0 puts MSB first
+  int16_t hi = buff[0];
+  int16_t lo = buff[1];
+
+  int16_t t128 = hi << 8 | lo;
+
+  // 13 bit readings are the same scale, just with flags at the bottom
+  if (!(config & CONFIG_16BIT))
+    t128 &= ~T13_FLAGS;
+
+  return t128;
+}
+
+int read_adt74x0(struct i2c_bus *bus, const uint8_t addr, const uint8_t config,
+		 int16_t *t128, uint8_t *alarms, struct xfer_time *when)
+{
+  uint8_t buff[4];
+
+  // A failure still says when it happened
+  if (bus->ops->set_addr(bus, addr) < 0)
+    {
+      const int64_t t = when ? now_ns() : 0;
+      set_when(when, t, t);
+      return -1;
+    }
+
+  const int64_t t0 = when ? now_ns() : 0;
+  const int stat   = bus->ops->read_reg(bus, T_MSB, buff, 2);
+  set_when(when, t0, when ? now_ns() : 0);
+
+  if (stat < 0)
+    return -6;
+
+  *t128 = decode_temp(buff, config);
+  if (alarms)
+    *alarms = decode_alarms(buff, config);
+
+  return 0;
+}
+
+void read_many_adt74x0(struct i2c_bus *bus, const uint8_t *addrs, const int n,
+		       const uint8_t config, int16_t *t128s, int *stats,
+		       uint8_t *alarms, struct xfer_time *whens)
+{
+  uint8_t buff[2 * I2C_ADDRS];
+
+  if (bus->ops->read_reg_many)
+    {
+      const int64_t t0 = whens ? now_ns() : 0;
+      const int stat   = bus->ops->read_reg_many(bus, addrs, n, T_MSB, buff, 2);
+      const int64_t t1 = whens ? now_ns() : 0;
+
+      if (stat == 0)
+	{
+	  for(int i = 0; i < n; i++)
+	    {
+	      t128s[i] = decode_temp(buff + 2 * i, config);
+	      stats[i] = 0;
+	      if (alarms)
+		alarms[i] = decode_alarms(buff + 2 * i, config);
+	      set_when(whens ? &whens[i] : NULL, t0, t1);
+	    }
+	  return;
+	}
+    }
+
+  // One at a time, either because we have to or to see who failed
+  for(int i = 0; i < n; i++)
+    stats[i] = read_adt74x0(bus, addrs[i], config, &t128s[i],
+			    alarms ? &alarms[i] : NULL, whens ? &whens[i] : NULL);
+}
+
+int format_adt74x0(char *buf, const int16_t t128)
+{
+  char *p = buf;
+
+  int32_t t = t128;
+  if (t < 0)
+    {
+      *p++ = '-';
+      t = -t;
+    }
+
+  // 1/128 = 0.0078125 so five decimal places need rounding: do it
+  // half-to-even like printf. 100000 / 128 = 3125 / 4.
+  uint32_t whole = t / T128_PER_C;
+  uint32_t frac4 = (t % T128_PER_C) * 3125;
+  uint32_t frac  = frac4 / 4;
+  uint32_t rem   = frac4 % 4;
+
+  if (rem > 2 || (rem == 2 && (frac & 1)))
+    frac++;
+
+  if (frac == 100000)
+    {
+      whole++;
+      frac = 0;
+    }
+
+  // Digits backwards into a scratch buffer, then copy
+  char tmp[8];
+  int  n = 0;
+  do
+    {
+      tmp[n++] = '0' + whole % 10;
+      whole /= 10;
+    }
+  while(whole);
+
+  while(n)
+    *p++ = tmp[--n];
+
+  *p++ = '.';
+  for(uint32_t d = 10000; d; d /= 10)
+    *p++ = '0' + (frac / d) % 10;
+
+  *p = '\0';
+  return p - buf;
+}
@@ -0,0 +1,277 @@
+/*
+ * Per chip handles, see adt74x0_dev.h.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#define _DEFAULT_SOURCE // So that we can usleep()
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "adt74x0_dev.h"
+
+static int retry(struct adt74x0_dev *dev, int stat, int16_t *t128,
+		 uint8_t *alarms, struct xfer_time *when);
+static void keep(struct adt74x0_dev *dev, const int stat, const int16_t t128,
+		 const uint8_t alarms, const struct xfer_time *when);
+static void good(struct adt74x0_dev *dev);
+static void note(struct adt74x0_dev *dev, const int stat);
+
+int open_dev(struct adt74x0_dev *dev, struct i2c_bus *shared,
+	     const char *path, const uint8_t addr)
+{
+  memset(dev, 0, sizeof(*dev));
+  dev->addr = addr;
+  dev->bus  = shared;
+  dev->seed = addr;
+
+  if (!shared->ops->reopen)
+    return 0;
+
+  dev->own.ops = shared->ops;
+  if (shared->ops->reopen(&dev->own, shared, path) < 0)
+    return -1;
+
+  dev->bus = &dev->own;
+
+  // Select the chip now, and then it stays selected
+  if (dev->own.ops->set_addr(&dev->own, addr) < 0)
+    {
+      close_dev(dev);
+      return -1;
+    }
+
+  return 0;
+}
+
+void close_dev(struct adt74x0_dev *dev)
+{
+  if (dev->bus == &dev->own)
+    dev->own.ops->close(&dev->own);
+
+  dev->bus   = NULL;
+  dev->state = 0;
+}
+
+int init_dev(struct adt74x0_dev *dev, const uint8_t config, const int warm)
+{
+  const int stat = start_init_dev(dev, config, warm);
+  if (stat != 0)
+    return stat;
+
+  usleep(RESET_US);
+
+  return finish_init_dev(dev);
+}
+
+int start_init_dev(struct adt74x0_dev *dev, const uint8_t config, const int warm)
+{
+  dev->config = config;
+  dev->warm   = warm && warm_adt74x0(dev->bus, dev->addr, config) > 0;
+
+  int stat = dev->warm ? 1 : reset_adt74x0(dev->bus, dev->addr);
+  for(int i = 0; stat < 0 && i < DEV_INIT_RETRIES; i++)
+    {
+      pause_retry(&dev->seed);
+      stat = reset_adt74x0(dev->bus, dev->addr);
+    }
+
+  dev->state = (stat < 0) ? stat : 1;
+  if (stat < 0)
+    note(dev, stat);
+
+  return stat;
+}
+
+int finish_init_dev(struct adt74x0_dev *dev)
+{
+  int stat = setup_adt74x0(dev->bus, dev->addr, dev->config);
+  for(int i = 0; stat < 0 && i < DEV_INIT_RETRIES; i++)
+    {
+      // A garbled IDREG may mean the clock's too fast for this chip
+      if (stat == -4 && dev->bus->ops->slow_down)
+	dev->bus->ops->slow_down(dev->bus, dev->addr);
+
+      pause_retry(&dev->seed);
+      stat = setup_adt74x0(dev->bus, dev->addr, dev->config);
+    }
+
+  dev->state = (stat < 0) ? stat : 1;
+  if (stat < 0)
+    note(dev, stat);
+
+  return stat;
+}
+
+void pause_retry(unsigned *seed)
+{
+  usleep(DEV_RETRY_US + rand_r(seed) % DEV_JITTER_US);
+}
+
+void move_dev(struct adt74x0_dev *to, struct adt74x0_dev *from)
+{
+  if (to == from)
+    return;
+
+  *to = *from;
+  if (from->bus == &from->own)
+    to->bus = &to->own;
+
+  from->bus = NULL;
+}
+
+int due_dev(struct adt74x0_dev *dev)
+{
+  if (dev->skip == 0)
+    return 1;
+
+  dev->skip--;
+  return 0;
+}
+
+int trigger_dev(struct adt74x0_dev *dev)
+{
+  const int stat = trigger_adt74x0(dev->bus, dev->addr, dev->config);
+  if (stat < 0)
+    note(dev, stat);
+
+  return stat;
+}
+
+int ready_dev(struct adt74x0_dev *dev)
+{
+  return ready_adt74x0(dev->bus, dev->addr);
+}
+
+int status_dev(struct adt74x0_dev *dev)
+{
+  const int stat = status_adt74x0(dev->bus, dev->addr);
+  if (stat < 0)
+    note(dev, stat);
+
+  return stat;
+}
+
+int limits_dev(struct adt74x0_dev *dev, const struct adt74x0_limits *limits)
+{
+  const int stat = limits_adt74x0(dev->bus, dev->addr, limits);
+  if (stat < 0)
+    note(dev, stat);
+  else
+    dev->has_limits = 1;
+
+  return stat;
+}
+
+int read_dev(struct adt74x0_dev *dev)
+{
+  int16_t          t128   = 0;
+  uint8_t          alarms = 0;
+  struct xfer_time when   = { 0 };
+
+  int stat = read_adt74x0(dev->bus, dev->addr, dev->config, &t128, &alarms, &when);
+  stat = retry(dev, stat, &t128, &alarms, &when);
+
+  keep(dev, stat, t128, alarms, &when);
+  return stat;
+}
+
+void read_many_dev(struct i2c_bus *shared, struct adt74x0_dev **devs, const int n,
+		   int *stats)
+{
+  // One transaction per chip, so use each chip's own handle
+  if (n == 0 || !shared->ops->read_reg_many)
+    {
+      for(int i = 0; i < n; i++)
+	stats[i] = read_dev(devs[i]);
+      return;
+    }
+
+  uint8_t          addrs[I2C_ADDRS] = { 0 };
+  int16_t          t128s[I2C_ADDRS]  = { 0 };
+  uint8_t          alarms[I2C_ADDRS] = { 0 };
+  struct xfer_time whens[I2C_ADDRS]  = { { 0 } };
+
+  for(int i = 0; i < n; i++)
+    addrs[i] = devs[i]->addr;
+
+  // They were all given the same config by the caller
+  read_many_adt74x0(shared, addrs, n, devs[0]->config, t128s, stats, alarms, whens);
+
+  for(int i = 0; i < n; i++)
+    {
+      stats[i] = retry(devs[i], stats[i], &t128s[i], &alarms[i], &whens[i]);
+      keep(devs[i], stats[i], t128s[i], alarms[i], &whens[i]);
+    }
+}
+
+// Note a reading, or count the failure. In 16 bit mode a chip with
+// limits needs STATUS read to see which it's passed: if that fails,
+// it just looks like none.
+static void keep(struct adt74x0_dev *dev, const int stat, const int16_t t128,
+		 const uint8_t alarms, const struct xfer_time *when)
+{
+  dev->reads++;
+  dev->when = *when;
+
+  if (stat < 0)
+    {
+      note(dev, stat);
+      return;
+    }
+
+  dev->t128   = t128;
+  dev->alarms = alarms;
+
+  if (dev->has_limits && (dev->config & CONFIG_16BIT))
+    {
+      const int status = status_adt74x0(dev->bus, dev->addr);
+      if (status >= 0)
+	dev->alarms = status & STATUS_ALARMS;
+    }
+
+  good(dev);
+}
+
+// If stat says a read failed, try again a few times, pausing for a
+// random while first (see pause_retry)
+static int retry(struct adt74x0_dev *dev, int stat, int16_t *t128,
+		 uint8_t *alarms, struct xfer_time *when)
+{
+  for(int i = 0; stat < 0 && i < DEV_RETRIES; i++)
+    {
+      pause_retry(&dev->seed);
+      stat = read_adt74x0(dev->bus, dev->addr, dev->config, t128, alarms, when);
+    }
+
+  return stat;
+}
+
+
+static void good(struct adt74x0_dev *dev)
+{
+  dev->fails   = 0;
+  dev->backoff = 0;
+}
+
+// Count the error against the chip, and quarantine it once it's failed
+// too often: for twice as long as last time if it didn't recover
+static void note(struct adt74x0_dev *dev, const int stat)
+{
+  dev->last_err = stat;
+  dev->errors++;
+
+  if (++dev->fails < DEV_BUDGET)
+    return;
+
+  dev->backoff = (dev->backoff == 0) ? 1 : 2 * dev->backoff;
+  if (dev->backoff > DEV_BACKOFF_MAX)
+    dev->backoff = DEV_BACKOFF_MAX;
+
+  dev->skip = dev->backoff;
+
+  // One more failure when it comes out and it's straight back in
+  dev->fails = DEV_BUDGET - 1;
+}
@@ -0,0 +1,115 @@
+/*
+ * A handle on each ADT74x0, which keeps what we know about the chip
+ * with its own connection to the bus.
+ *
+ * If the backend can reopen the adapter (smbus), every chip gets its
+ * own fd with its address selected once and for all. Otherwise (rdwr,
+ * which doesn't need it, and bcm2835, which can't) chips share the
+ * bus they were found on.
+ *
+ * Reads which fail are retried a couple of times after a short random
+ * pause, so a glitch doesn't cost a sample. Starting up only happens
+ * once, so the reset and set up are given more tries than that: one
+ * glitch there would otherwise lose the chip for good. A chip which
+ * still fails DEV_BUDGET times in a row is quarantined: due_dev says
+ * to leave it alone for a sweep, then two, four, ... up to
+ * DEV_BACKOFF_MAX sweeps, getting a single chance in between, so a
+ * dead chip costs next to no bus time. One good reading lets it out.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#ifndef ADT74X0_DEV_H
+#define ADT74X0_DEV_H
+
+#include <stdint.h>
+
+#include "adt74x0.h"
+
+/* Extra tries at a read, or at probing and starting up a chip, each
+   after 100us plus up to 200us more */
+#define DEV_RETRIES      2
+#define DEV_INIT_RETRIES 5
+#define DEV_RETRY_US     100
+#define DEV_JITTER_US    200
+
+/* Failed reads in a row before quarantine, and the longest one */
+#define DEV_BUDGET       3
+#define DEV_BACKOFF_MAX  64
+
+struct adt74x0_dev
+{
+  struct i2c_bus  *bus;     // either &own or the shared bus
+  struct i2c_bus   own;
+  uint8_t          addr;
+
+  // +ve good, 0 not in use, -ve the error from init_dev
+  int              state;
+  int              warm;    // already converting when we started
+
+  uint8_t          config;  // last written to CONFIG
+
+  // Last good reading, and the STATUS_ALARMS it came with
+  int16_t          t128;
+  uint8_t          alarms;
+  struct xfer_time when;
+
+  // limits_dev has been called, so alarms are wanted
+  int              has_limits;
+
+  int              last_err;
+  unsigned long    reads;
+  unsigned long    errors;
+
+  // Quarantine, see above
+  int              fails;     // in a row
+  unsigned         skip;      // sweeps left to sit out
+  unsigned         backoff;   // how many the last quarantine was
+  unsigned         seed;      // for the retry jitter
+};
+
+// All return 0 if OK (or as noted), -ve to show error
+
+// Get a handle on the chip at addr on shared, which was opened with path
+int  open_dev(struct adt74x0_dev *dev, struct i2c_bus *shared,
+	      const char *path, const uint8_t addr);
+void close_dev(struct adt74x0_dev *dev);
+
+// Reset and set up the chip, unless warm and warm_adt74x0 says it can
+// be left alone, and note the result in dev->state
+int  init_dev(struct adt74x0_dev *dev, const uint8_t config, const int warm);
+
+// init_dev in two halves so several chips can share the wait after
+// RESET. start_init_dev returns 1 if the chip's warm and that's it,
+// or 0 if it's been reset: then wait RESET_US and finish_init_dev it.
+int  start_init_dev(struct adt74x0_dev *dev, const uint8_t config, const int warm);
+int  finish_init_dev(struct adt74x0_dev *dev);
+
+// The pause before any retry, probing included: DEV_RETRY_US plus a
+// random part of DEV_JITTER_US from rand_r(seed), so retries don't
+// fall into step with whatever upset the bus
+void pause_retry(unsigned *seed);
+
+// Move a handle to another slot, e.g. to keep a list packed
+void move_dev(struct adt74x0_dev *to, struct adt74x0_dev *from);
+
+// Return 0 if the chip's in quarantine and should sit this sweep out,
+// else 1. Call once per sweep.
+int  due_dev(struct adt74x0_dev *dev);
+
+int  trigger_dev(struct adt74x0_dev *dev);
+int  ready_dev(struct adt74x0_dev *dev);
+int  status_dev(struct adt74x0_dev *dev);
+// Once a chip has limits, reads in 16 bit mode read STATUS too, to
+// fill in dev->alarms: in 13 bit mode they come free with the reading
+int  limits_dev(struct adt74x0_dev *dev, const struct adt74x0_limits *limits);
+
+// read_adt74x0 into dev->t128 and dev->when, with retries
+int  read_dev(struct adt74x0_dev *dev);
+
+// read_dev each of n chips, all of which must be on shared, in one bus
+// transaction if the backend can. stats[i] is what read_dev returns.
+void read_many_dev(struct i2c_bus *shared, struct adt74x0_dev **devs, const int n,
+		   int *stats);
+
+#endif
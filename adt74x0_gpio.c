@@ -0,0 +1,134 @@
+/*
+ * GPIO edge events, see adt74x0_gpio.h.
+ *
+ * This uses the v2 uAPI in <linux/gpio.h>, so needs Linux 5.10 or later.
+ *
+ * Errors:
+ *   -1 the spec doesn't make sense
+ *   -2 opening the gpiochip
+ *   -3 requesting the lines
+ *   -4 setting up epoll
+ *   -5 waiting or reading events
+ *   -6 reading the lines' values
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <linux/gpio.h>
+
+#include "adt74x0_gpio.h"
+
+int gpio_open(struct gpio_lines *g, const char *spec)
+{
+  struct gpio_v2_line_request req;
+  memset(&req, 0, sizeof(req));
+
+  g->line_fd  = -1;
+  g->epoll_fd = -1;
+
+  // path:line,line,...
+  const char *colon = strrchr(spec, ':');
+  if (!colon || colon == spec)
+    return -1;
+
+  char path[256];
+  snprintf(path, sizeof(path), "%.*s", (int)(colon - spec), spec);
+
+  for(const char *p = colon + 1; *p; )
+    {
+      char *end;
+      const long line = strtol(p, &end, 10);
+      if (end == p || line < 0 || req.num_lines == GPIO_V2_LINES_MAX)
+	return -1;
+
+      if (*end && *end != ',')
+	return -1;
+
+      req.offsets[req.num_lines++] = line;
+      p = (*end == ',') ? end + 1 : end;
+    }
+
+  if (req.num_lines == 0)
+    return -1;
+
+  snprintf(req.consumer, sizeof(req.consumer), "adt74x0");
+  req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+
+  const int chip_fd = open(path, O_RDWR | O_CLOEXEC);
+  if (chip_fd < 0)
+    return -2;
+
+  const int stat = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req);
+  close(chip_fd);
+  if (stat < 0)
+    return -3;
+
+  g->line_fd = req.fd;
+  g->n_lines = req.num_lines;
+
+  // So that gpio_wait can read until there's nothing left
+  fcntl(g->line_fd, F_SETFL, fcntl(g->line_fd, F_GETFL) | O_NONBLOCK);
+
+  struct epoll_event ev = { .events = EPOLLIN, .data.fd = g->line_fd };
+  if ((g->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0
+      || epoll_ctl(g->epoll_fd, EPOLL_CTL_ADD, g->line_fd, &ev) < 0)
+    {
+      gpio_close(g);
+      return -4;
+    }
+
+  return 0;
+}
+
+void gpio_close(struct gpio_lines *g)
+{
+  if (g->epoll_fd >= 0)
+    close(g->epoll_fd);
+  if (g->line_fd >= 0)
+    close(g->line_fd);
+
+  g->epoll_fd = -1;
+  g->line_fd  = -1;
+}
+
+int gpio_wait(struct gpio_lines *g, const int timeout_ms)
+{
+  struct epoll_event ev;
+
+  const int n = epoll_wait(g->epoll_fd, &ev, 1, timeout_ms);
+  if (n < 0)
+    return (errno == EINTR) ? 0 : -5;
+  if (n == 0)
+    return 0;
+
+  // Edges which come together are all dealt with by one look at STATUS
+  struct gpio_v2_line_event events[16];
+  ssize_t len;
+  while((len = read(g->line_fd, events, sizeof(events))) > 0)
+    ;
+
+  if (len < 0 && errno != EAGAIN)
+    return -5;
+
+  return 1;
+}
+
+int gpio_low(struct gpio_lines *g)
+{
+  struct gpio_v2_line_values values =
+    { .mask = (g->n_lines == GPIO_V2_LINES_MAX) ? ~0ULL : (1ULL << g->n_lines) - 1 };
+
+  if (ioctl(g->line_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0)
+    return -6;
+
+  // Not requested active low, so 0 is low
+  return (values.bits & values.mask) != values.mask;
+}
@@ -0,0 +1,41 @@
+/*
+ * Waiting for the ADT74x0 INT and CT pins, through the kernel's GPIO
+ * character device.
+ *
+ * Both pins are open drain and active low by default, so each needs
+ * a pull-up, and an edge we care about is a falling one. Several
+ * chips' pins can share a line: whoever's waiting then has to read
+ * STATUS to see which chip it was. A pin in comparator mode (CT
+ * always, INT with -p comparator) holds a shared line low for as long
+ * as its chip's past the limit, so another chip going past its own
+ * makes no edge: while gpio_low says so, STATUS has to be polled.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#ifndef ADT74X0_GPIO_H
+#define ADT74X0_GPIO_H
+
+struct gpio_lines
+{
+  int line_fd;    // the lines' edge events
+  int epoll_fd;
+  int n_lines;
+};
+
+// All return 0 if OK (or as noted), -ve to show error
+
+// Request falling edge events on lines given like
+// "/dev/gpiochip0:17" or "/dev/gpiochip0:17,27"
+int  gpio_open(struct gpio_lines *g, const char *spec);
+void gpio_close(struct gpio_lines *g);
+
+// Wait for an edge on any of the lines for up to timeout_ms, or for
+// ever if that's -1. Return 1 if there were any (which are then all
+// consumed), 0 if we timed out.
+int  gpio_wait(struct gpio_lines *g, const int timeout_ms);
+
+// Return 1 if any of the lines is low now, else 0
+int  gpio_low(struct gpio_lines *g);
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Writing readings out, see adt74x0_out.h.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#include <string.h>
+
+#include "adt74x0.h"
+#include "adt74x0_out.h"
+
+// Readers rely on the record having no padding
+typedef char sample_is_32_bytes[(sizeof(struct sample) == 32) ? 1 : -1];
+
+int out_format_lookup(const char *name)
+{
+  if (strcmp(name, "text")   == 0) return OUT_TEXT;
+  if (strcmp(name, "binary") == 0) return OUT_BINARY;
+  return -1;
+}
+
+int out_clock_lookup(const char *name)
+{
+  if (strcmp(name, "mono") == 0) return OUT_MONO;
+  if (strcmp(name, "real") == 0) return OUT_REAL;
+  return -1;
+}
+
+void out_begin(struct output *out)
+{
+  if (out->format != OUT_BINARY)
+    return;
+
+  struct out_header h =
+    { .magic = OUT_MAGIC, .version = OUT_VERSION, .record_size = sizeof(struct sample) };
+
+  fwrite(&h, sizeof(h), 1, out->f);
+}
+
+void out_sample(struct output *out, const struct sample *s)
+{
+  if (out->format == OUT_BINARY)
+    {
+      fwrite(s, sizeof(*s), 1, out->f);
+      return;
+    }
+
+  // e.g. "1234.567890 " seconds to the microsecond
+  char when[32] = "";
+  if (out->clock != OUT_NO_CLOCK)
+    {
+      const int64_t us = ((out->clock == OUT_REAL) ? s->real_ns : s->mono_ns) / 1000;
+      snprintf(when, sizeof(when), "%lld.%06lld ",
+	       (long long)(us / 1000000), (long long)(us % 1000000));
+    }
+
+  char bus[8] = "";
+  if (out->multi_bus)
+    snprintf(bus, sizeof(bus), "%d:", s->bus);
+
+  if (s->stat < 0)
+    {
+      fprintf(out->f, "# %s%s0x%02x error %d\n", when, bus, s->addr, s->stat);
+      return;
+    }
+
+  char t[FORMAT_ADT74X0_LEN];
+  format_adt74x0(t, s->t128);
+
+  // e.g. " high crit"
+  fprintf(out->f, "%s%s0x%02x %sC%s%s%s\n", when, bus, s->addr, t,
+	  (s->alarms & STATUS_T_LOW)  ? " low"  : "",
+	  (s->alarms & STATUS_T_HIGH) ? " high" : "",
+	  (s->alarms & STATUS_T_CRIT) ? " crit" : "");
+}
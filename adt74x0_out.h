@@ -0,0 +1,63 @@
+/*
+ * Writing readings out, as text or as fixed size binary records.
+ *
+ * The binary format is a header then one record per reading, all in
+ * the host's byte order: a reader can tell if that's not its own
+ * from the magic number.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#ifndef ADT74X0_OUT_H
+#define ADT74X0_OUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define OUT_MAGIC   0x30744441  // "ADt0" on little-endian machines
+#define OUT_VERSION 3
+
+struct out_header
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;  // sizeof(struct sample)
+};
+
+/* One reading: also exactly what's written in binary mode */
+struct sample
+{
+  int64_t  mono_ns;   // CLOCK_MONOTONIC half way through the bus transaction
+  int64_t  real_ns;   // the same moment by CLOCK_REALTIME, or 0 if not wanted
+  uint8_t  addr;
+  uint8_t  bus;       // index of the bus on the command line
+  int16_t  t128;      // 1/128 C, if stat is 0
+  int16_t  stat;      // 0 if OK, else -ve error from adt74x0_chip.c
+  uint16_t xfer_us;   // how long the bus transaction took, at most 65535
+  uint8_t  alarms;    // STATUS_ALARMS bits (see adt74x0.h) if known, else 0
+  uint8_t  spare[7];
+};
+
+enum out_format { OUT_TEXT, OUT_BINARY };
+
+/* Which time to put on text lines, and whether to fill in real_ns */
+enum out_clock { OUT_NO_CLOCK, OUT_MONO, OUT_REAL };
+
+struct output
+{
+  FILE *f;
+  enum out_format format;
+  enum out_clock  clock;
+  int multi_bus;   // prefix text lines with the bus number
+};
+
+// Look up a format or clock by name, -1 if unknown
+int out_format_lookup(const char *name);
+int out_clock_lookup(const char *name);
+
+// Write the binary header, or nothing for text
+void out_begin(struct output *out);
+
+void out_sample(struct output *out, const struct sample *s);
+
+#endif
@@ -0,0 +1,215 @@
+/*
+ * Probing and the topology cache, see adt74x0_probe.h.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "adt74x0_probe.h"
+#include "adt74x0_dev.h"
+
+#define TOPO_MAX  64
+#define TOPO_LINE 1024
+
+struct topo
+{
+  char   *backend;
+  char   *path;
+  char   *ranges;
+  int     n;
+  uint8_t addrs[I2C_ADDRS];
+};
+
+static struct topo     topos[TOPO_MAX];
+static int             n_topos = 0;
+static pthread_mutex_t topo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct topo *topo_find(const char *backend, const char *path, const char *ranges);
+static int topo_write(const char *file);
+static int probe_retry(struct i2c_bus *bus, const uint8_t addr);
+
+int probe_parse(const char *ranges, const int good_bus, uint8_t *want)
+{
+  char *copy = strdup(ranges);
+  int   stat = 0;
+  int   any  = 0;
+
+  for(char *save, *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+      char *end;
+      long lo = strtol(tok, &end, 16);
+      long hi = (*end == '-') ? strtol(end + 1, &end, 16) : lo;
+      if (*end || lo < 0 || hi >= I2C_ADDRS || lo > hi)
+	{ stat = -1; break; }
+
+      if (!good_bus && (lo < PROBE_FIRST || hi > PROBE_LAST))
+	{ stat = -2; break; }
+
+      for(long a = lo; a <= hi; a++)
+	want[a] = 1;
+      any = 1;
+    }
+
+  free(copy);
+  return (stat == 0 && !any) ? -1 : stat;
+}
+
+int probe_bus(struct i2c_bus *bus, const uint8_t *want, uint8_t *addrs)
+{
+  int n = 0;
+
+  for(int a = 0; a < I2C_ADDRS; a++)
+    if (want[a] && probe_retry(bus, a) == 0)
+      addrs[n++] = a;
+
+  return n;
+}
+
+// A NAK could be a glitch rather than an empty address, so give it
+// as many tries as init_dev gets. Something which answers with the
+// wrong IDREG isn't going to change its mind, unless it's garbled by
+// too fast a clock and the backend can slow down.
+static int probe_retry(struct i2c_bus *bus, const uint8_t addr)
+{
+  unsigned seed = addr;
+
+  int stat = probe_adt74x0(bus, addr);
+  for(int i = 0; stat < 0 && i < DEV_INIT_RETRIES; i++)
+    {
+      if (stat == -4 && !(bus->ops->slow_down && bus->ops->slow_down(bus, addr) == 0))
+	break;
+
+      pause_retry(&seed);
+      stat = probe_adt74x0(bus, addr);
+    }
+
+  return stat;
+}
+
+int topo_load(const char *file)
+{
+  FILE *f = fopen(file, "r");
+  if (!f)
+    return (errno == ENOENT) ? 0 : -1;
+
+  char line[TOPO_LINE];
+  while(n_topos < TOPO_MAX && fgets(line, sizeof(line), f))
+    {
+      if (line[0] == '#')
+	continue;
+
+      char *save;
+      char *backend = strtok_r(line, " \t\n", &save);
+      char *path    = strtok_r(NULL, " \t\n", &save);
+      char *ranges  = strtok_r(NULL, " \t\n", &save);
+      if (!ranges)
+	continue;
+
+      struct topo *t = &topos[n_topos];
+      t->n = 0;
+      for(char *a; t->n < I2C_ADDRS && (a = strtok_r(NULL, " \t\n", &save)); )
+	t->addrs[t->n++] = strtol(a, NULL, 16) & 0x7f;
+
+      t->backend = strdup(backend);
+      t->path    = strdup(path);
+      t->ranges  = strdup(ranges);
+      n_topos++;
+    }
+
+  fclose(f);
+  return n_topos;
+}
+
+int topo_lookup(const char *backend, const char *path, const char *ranges,
+		uint8_t *addrs)
+{
+  pthread_mutex_lock(&topo_lock);
+
+  const struct topo *t = topo_find(backend, path, ranges);
+  const int n = t ? t->n : -1;
+  if (t)
+    memcpy(addrs, t->addrs, n);
+
+  pthread_mutex_unlock(&topo_lock);
+  return n;
+}
+
+int topo_store(const char *file, const char *backend, const char *path,
+	       const char *ranges, const uint8_t *addrs, const int n)
+{
+  int stat = 0;
+
+  pthread_mutex_lock(&topo_lock);
+
+  struct topo *t = topo_find(backend, path, ranges);
+  if (!t || t->n != n || memcmp(t->addrs, addrs, n) != 0)
+    {
+      if (!t && n_topos < TOPO_MAX)
+	{
+	  t = &topos[n_topos++];
+	  t->backend = strdup(backend);
+	  t->path    = strdup(path);
+	  t->ranges  = strdup(ranges);
+	}
+
+      if (t)
+	{
+	  t->n = n;
+	  memcpy(t->addrs, addrs, n);
+	}
+
+      stat = topo_write(file);
+    }
+
+  pthread_mutex_unlock(&topo_lock);
+  return stat;
+}
+
+static struct topo *topo_find(const char *backend, const char *path, const char *ranges)
+{
+  for(int i = 0; i < n_topos; i++)
+    if (strcmp(topos[i].backend, backend) == 0
+	&& strcmp(topos[i].path, path) == 0
+	&& strcmp(topos[i].ranges, ranges) == 0)
+      return &topos[i];
+
+  return NULL;
+}
+
+// Write to a temporary file and rename it, so a crash never leaves
+// half a cache behind
+static int topo_write(const char *file)
+{
+  char tmp[TOPO_LINE];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+
+  FILE *f = fopen(tmp, "w");
+  if (!f)
+    return -1;
+
+  fprintf(f, "# adt74x0 topology cache: backend path ranges addr ...\n");
+  for(int i = 0; i < n_topos; i++)
+    {
+      const struct topo *t = &topos[i];
+
+      fprintf(f, "%s %s %s", t->backend, t->path, t->ranges);
+      for(int j = 0; j < t->n; j++)
+	fprintf(f, " %02x", t->addrs[j]);
+      fprintf(f, "\n");
+    }
+
+  if (fclose(f) != 0 || rename(tmp, file) != 0)
+    {
+      remove(tmp);
+      return -1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * Finding ADT74x0s: probing ranges of addresses on a bus, and keeping
+ * what was found in a cache file so that the next start can skip it.
+ *
+ * The cache is a text file with a line per bus:
+ *
+ *   backend path ranges addr ...
+ *
+ * e.g. "smbus /dev/i2c-1 48-4b 48 4a". A line is only used if the
+ * backend, path and ranges all match, so changing any of them means
+ * probing afresh. Paths can't contain spaces.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#ifndef ADT74X0_PROBE_H
+#define ADT74X0_PROBE_H
+
+#include <stdint.h>
+
+#include "adt74x0.h"
+
+/* Every address an ADT74x0 can have */
+#define PROBE_DEFAULT "48-4b"
+#define PROBE_FIRST   0x48
+#define PROBE_LAST    0x4b
+
+// Parse hex ranges like "48-4b,4f" setting want[addr] for each address.
+// Return 0 if OK, -1 if they don't make sense, or -2 if they go outside
+// PROBE_DEFAULT when !good_bus: without IDREG to check, whatever else
+// answers would be taken for an ADT74x0, reset and written to.
+int probe_parse(const char *ranges, const int good_bus, uint8_t *want);
+
+// probe_adt74x0 every address in want, putting those which answer in
+// addrs. Return how many there are. Addresses which don't answer are
+// tried again like init_dev does, so each costs a millisecond or so.
+int probe_bus(struct i2c_bus *bus, const uint8_t *want, uint8_t *addrs);
+
+// Read the cache file: return the number of buses in it, or -1 if it
+// can't be read. A missing cache is just empty.
+int topo_load(const char *file);
+
+// Put the cached addresses into addrs and return how many, or -1 if
+// the bus isn't in the cache
+int topo_lookup(const char *backend, const char *path, const char *ranges,
+		uint8_t *addrs);
+
+// Remember the addresses found on a bus and rewrite the file if that's
+// news. Safe to call from several threads. Return 0 if OK, -1 if the
+// file couldn't be written.
+int topo_store(const char *file, const char *backend, const char *path,
+	       const char *ranges, const uint8_t *addrs, const int n);
+
+#endif
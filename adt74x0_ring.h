@@ -0,0 +1,68 @@
+/*
+ * A single producer, single consumer, lock-free ring of samples.
+ *
+ * The producer (a bus thread) never blocks: if the consumer (the
+ * output thread) has fallen behind, the sample is dropped and
+ * counted instead.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#ifndef ADT74X0_RING_H
+#define ADT74X0_RING_H
+
+#include "adt74x0_out.h"
+
+#define RING_SIZE 1024  // must be a power of 2
+
+#define CACHE_LINE 64
+
+struct ring
+{
+  // Each index is only written by one side, and they live on
+  // different cache lines so the two threads don't fight over them
+  unsigned long head __attribute__((aligned(CACHE_LINE)));  // producer
+  unsigned long overflows;                                  // producer
+  unsigned long tail __attribute__((aligned(CACHE_LINE)));  // consumer
+
+  struct sample buf[RING_SIZE] __attribute__((aligned(CACHE_LINE)));
+};
+
+// Producer: return 0 if OK, -1 if full and the sample was dropped
+static inline int ring_push(struct ring *r, const struct sample *s)
+{
+  const unsigned long head = r->head;
+  const unsigned long tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+  if (head - tail >= RING_SIZE)
+    {
+      __atomic_store_n(&r->overflows, r->overflows + 1, __ATOMIC_RELAXED);
+      return -1;
+    }
+
+  r->buf[head & (RING_SIZE - 1)] = *s;
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+// Consumer: return 1 and set *s if there was a sample, 0 if empty
+static inline int ring_pop(struct ring *r, struct sample *s)
+{
+  const unsigned long tail = r->tail;
+  const unsigned long head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+  if (head == tail)
+    return 0;
+
+  *s = r->buf[tail & (RING_SIZE - 1)];
+  __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+// Either side: how many samples have been dropped
+static inline unsigned long ring_overflows(struct ring *r)
+{
+  return __atomic_load_n(&r->overflows, __ATOMIC_RELAXED);
+}
+
+#endif
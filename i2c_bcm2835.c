@@ -0,0 +1,273 @@
+/*
+ * I2C backend for the Raspberry Pi which uses Mike McCauley's
+ * bcm2835 library http://www.airspayce.com/mikem/bcm2835/index.html
+ * instead of the I2C drivers in the kernel.
+ *
+ * The kernel driver fails dismally with multiple sensors on the bus,
+ * but the I2C support in libbcm2835 only supports revision 2 of the
+ * Raspberry Pi hardware.
+ *
+ * The path given to open sets the clock, anything else (e.g.
+ * /dev/i2c-0) is ignored:
+ *
+ *   baud=10000   run the bus at this rate, as near as the clock divider
+ *                allows (the default)
+ *   baud=auto    start at 400kHz, and slow down through 100kHz, 50kHz,
+ *                20kHz to 10kHz while there are too many errors
+ *
+ * 10kHz copes with long cables and dodgy termination, but a well
+ * wired bus is fine at 400kHz, so auto finds the fastest rate which
+ * works for each chip separately, and switches the clock divider
+ * whenever a different chip is selected. So one badly cabled chip
+ * only slows down its own reads. A NAK from an address which has
+ * never answered may just be an empty address, so it isn't counted,
+ * but the next try at that address is a rate slower: so probing, which
+ * tries each address several times, works its way down to 10kHz and
+ * still finds a chip which can only manage that. The same goes for a
+ * chip whose IDREG comes back garbled (see slow_down in i2c_bus.h).
+ * After a long spell without errors it tries the next rate up again,
+ * in case the errors were a passing problem.
+ *
+ * Only built if WITH_BCM2835 is defined.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#ifdef WITH_BCM2835
+
+#include <stdlib.h>
+#include <string.h>
+#include <bcm2835.h>
+
+#include "i2c_bus.h"
+
+/* Fastest first */
+static const uint32_t bauds[] = { 400000, 100000, 50000, 20000, 10000 };
+
+#define N_BAUDS (int)(sizeof(bauds) / sizeof(bauds[0]))
+
+/* Judge the error rate every BCM_WINDOW transactions: more than
+   BCM_MAX_ERRORS and slow down, none for BCM_CLEAN_WINDOWS in a row
+   and speed up */
+#define BCM_WINDOW        64
+#define BCM_MAX_ERRORS    2
+#define BCM_CLEAN_WINDOWS 64
+
+/* What we know about the chip at each address */
+struct bcm_dev
+{
+  uint8_t  known;     // has answered
+  int8_t   level;     // index into bauds[]
+
+  uint16_t xfers;     // in this window
+  uint16_t errors;
+  uint16_t clean;     // windows without errors
+};
+
+struct bcm_bus
+{
+  int      adaptive;
+  uint32_t fixed;     // baud=N, else 0 to start from bauds[level]
+  int      level;     // what the hardware's set to
+
+  struct bcm_dev devs[128];
+};
+
+// Errors are -ve bcm2835 reason codes
+
+static void set_baud(struct bcm_bus *b, const int level)
+{
+  if (level == b->level)
+    return;
+
+  b->level = level;
+  bcm2835_i2c_set_baudrate(bauds[level]);
+}
+
+// Change the chip at addr's rate, and the clock too if it's selected
+static void set_level(struct i2c_bus *bus, const uint8_t addr, const int level)
+{
+  struct bcm_bus *b = bus->priv;
+  struct bcm_dev *d = &b->devs[addr & 0x7f];
+
+  d->level  = level;
+  d->xfers  = 0;
+  d->errors = 0;
+  d->clean  = 0;
+
+  if (bus->addr == addr)
+    set_baud(b, level);
+}
+
+static int parse_config(struct bcm_bus *b, const char *path)
+{
+  char *copy = strdup(path);
+  int   stat = 0;
+
+  for(char *save, *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+      char *val = strchr(tok, '=');
+      if (!val)
+	continue;
+      *val++ = '\0';
+
+      if (strcmp(tok, "baud") != 0)
+	{ stat = -1; break; }
+
+      if (strcmp(val, "auto") == 0)
+	{
+	  b->adaptive = 1;
+	  b->level    = 0;
+	}
+      else
+	{
+	  const long baud = atol(val);
+	  if (baud <= 0)
+	    { stat = -1; break; }
+
+	  b->adaptive = 0;
+	  b->fixed    = baud;
+	}
+    }
+
+  free(copy);
+  return stat;
+}
+
+// Note how a transaction with the selected chip went, and change its
+// speed if that's called for
+static int account(struct i2c_bus *bus, const uint8_t reason)
+{
+  struct bcm_bus *b = bus->priv;
+  struct bcm_dev *d = &b->devs[bus->addr & 0x7f];
+
+  if (reason == BCM2835_I2C_REASON_OK)
+    d->known = 1;
+  else if (!d->known)
+    {
+      // Maybe nobody there, maybe too fast for them: try slower next
+      if (b->adaptive && d->level < N_BAUDS - 1)
+	set_level(bus, bus->addr, d->level + 1);
+      return -reason;
+    }
+
+  if (!b->adaptive)
+    return -reason;
+
+  d->xfers++;
+  d->errors += reason != BCM2835_I2C_REASON_OK;
+
+  if (d->errors > BCM_MAX_ERRORS && d->level < N_BAUDS - 1)
+    set_level(bus, bus->addr, d->level + 1);
+  else if (d->xfers >= BCM_WINDOW)
+    {
+      d->clean  = d->errors ? 0 : d->clean + 1;
+      d->xfers  = 0;
+      d->errors = 0;
+
+      if (d->clean >= BCM_CLEAN_WINDOWS && d->level > 0)
+	set_level(bus, bus->addr, d->level - 1);
+    }
+
+  return -reason;
+}
+
+static int bcm_open(struct i2c_bus *bus, const char *path)
+{
+  struct bcm_bus *b = calloc(1, sizeof(*b));
+  if (!b)
+    return -1;
+
+  // By default slowing down to 10kHz (std is 100kHz) works better
+  // when the cables are long and termination dodgy...
+  b->level = N_BAUDS - 1;
+
+  if (parse_config(b, path) < 0)
+    {
+      free(b);
+      return -2;
+    }
+
+  if (!bcm2835_init())
+    {
+      free(b);
+      return -1;
+    }
+
+  bus->fd   = -1;
+  bus->addr = I2C_NO_ADDR;
+  bus->priv = b;
+
+  for(int a = 0; a < 128; a++)
+    b->devs[a].level = b->level;
+
+  bcm2835_i2c_begin();
+  bcm2835_i2c_set_baudrate(b->fixed ? b->fixed : bauds[b->level]);
+
+  return 0;
+}
+
+static void bcm_close(struct i2c_bus *bus)
+{
+  bcm2835_i2c_end();
+  bcm2835_close();
+
+  free(bus->priv);
+  bus->priv = NULL;
+}
+
+static int bcm_set_addr(struct i2c_bus *bus, uint8_t addr)
+{
+  if (addr == bus->addr)
+    return 0;
+
+  struct bcm_bus *b = bus->priv;
+
+  bcm2835_i2c_setSlaveAddress(addr);
+  if (b->adaptive)
+    set_baud(b, b->devs[addr & 0x7f].level);
+
+  bus->addr = addr;
+  return 0;
+}
+
+static int bcm_slow_down(struct i2c_bus *bus, uint8_t addr)
+{
+  struct bcm_bus *b = bus->priv;
+  struct bcm_dev *d = &b->devs[addr & 0x7f];
+
+  if (!b->adaptive || d->level == N_BAUDS - 1)
+    return -1;
+
+  set_level(bus, addr, d->level + 1);
+  return 0;
+}
+
+static int bcm_write(struct i2c_bus *bus, const uint8_t *buf, int len)
+{
+  bus->xfers++;
+  return account(bus, bcm2835_i2c_write((const char *)buf, len));
+}
+
+static int bcm_read_reg(struct i2c_bus *bus, uint8_t reg, uint8_t *buf, int len)
+{
+  bus->xfers++;
+
+  char r = reg;
+  return account(bus, bcm2835_i2c_read_register_rs(&r, (char *)buf, len));
+}
+
+const struct i2c_bus_ops i2c_bcm2835_ops =
+  {
+    .name     = "bcm2835",
+    .good_bus = 1,
+    .one_bus  = 1,
+    .open     = bcm_open,
+    .close    = bcm_close,
+    .set_addr = bcm_set_addr,
+    .write    = bcm_write,
+    .read_reg = bcm_read_reg,
+    .slow_down = bcm_slow_down,
+  };
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ * Table of I2C backends compiled into adt74x0.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#include <string.h>
+
+#include "i2c_bus.h"
+
+static const struct i2c_bus_ops *backends[] =
+  {
+    &i2c_smbus_ops,
+    &i2c_rdwr_ops,
+    &i2c_mock_ops,
+#ifdef WITH_BCM2835
+    &i2c_bcm2835_ops,
+#endif
+    NULL
+  };
+
+const struct i2c_bus_ops *i2c_bus_lookup(const char *name)
+{
+  for(int i = 0; backends[i]; i++)
+    if (strcmp(backends[i]->name, name) == 0)
+      return backends[i];
+
+  return NULL;
+}
+
+void i2c_bus_list(FILE *f)
+{
+  for(int i = 0; backends[i]; i++)
+    fprintf(f, "%s%s", i ? ", " : "", backends[i]->name);
+}
@@ -0,0 +1,89 @@
+/*
+ * A minimal I2C transport interface, so that the ADT74x0 code
+ * doesn't care whether it's talking through the kernel's
+ * /dev/i2c-N driver or poking the BCM2835 registers directly.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+struct i2c_bus;
+
+// All functions return 0 if OK, -ve to show error
+struct i2c_bus_ops
+{
+  const char *name;
+
+  // Non-zero if reads other than the temperature are trustworthy,
+  // which isn't the case with the kernel driver on the Raspberry Pi
+  int good_bus;
+
+  // Non-zero if there's only the one bus (e.g. bcm2835, which drives
+  // the controller directly), so it can't be given several paths
+  int one_bus;
+
+  int  (*open)(struct i2c_bus *bus, const char *path);
+  void (*close)(struct i2c_bus *bus);
+
+  // Select the slave for subsequent transfers
+  int  (*set_addr)(struct i2c_bus *bus, uint8_t addr);
+
+  // Write len bytes, in wire order, so buf[0] is usually a register
+  // e.g. len = 1 for a command byte, 2 for a byte register, 3 for a word
+  int  (*write)(struct i2c_bus *bus, const uint8_t *buf, int len);
+
+  // Combined write of the register pointer then read of len bytes
+  // with a repeated start. buf is in wire order.
+  int  (*read_reg)(struct i2c_bus *bus, uint8_t reg, uint8_t *buf, int len);
+
+  // Optional, may be NULL. Like read_reg but for each of n slaves in
+  // a single bus transaction: buf gets n * len bytes. Fails as a whole
+  // so callers should fall back to read_reg to find the culprit.
+  int  (*read_reg_many)(struct i2c_bus *bus, const uint8_t *addrs, int n,
+			uint8_t reg, uint8_t *buf, int len);
+
+  // Optional, may be NULL. Open another handle on the same adapter as
+  // from, which was opened with path, with its own slave selection so
+  // that each chip can have one and keep its address selected.
+  int  (*reopen)(struct i2c_bus *bus, const struct i2c_bus *from, const char *path);
+
+  // Optional, may be NULL. What was read from addr made no sense, which
+  // may be the clock being too fast for it: talk to it more slowly from
+  // now on. Fails if it can't go any slower.
+  int  (*slow_down)(struct i2c_bus *bus, uint8_t addr);
+};
+
+/* Not a 7 bit address, so nothing's selected */
+#define I2C_NO_ADDR 0xff
+
+struct i2c_bus
+{
+  const struct i2c_bus_ops *ops;
+  int fd;         // kernel backends only
+  uint8_t addr;   // currently selected slave, or I2C_NO_ADDR
+  void *priv;     // backend's own state
+
+  // Number of syscalls (or bus transactions for backends which
+  // don't use the kernel) made so far, for benchmarking
+  unsigned long xfers;
+};
+
+extern const struct i2c_bus_ops i2c_smbus_ops;
+extern const struct i2c_bus_ops i2c_rdwr_ops;
+extern const struct i2c_bus_ops i2c_mock_ops;
+#ifdef WITH_BCM2835
+extern const struct i2c_bus_ops i2c_bcm2835_ops;
+#endif
+
+// Look up a backend by name, NULL if unknown
+const struct i2c_bus_ops *i2c_bus_lookup(const char *name);
+
+// Print the names of all backends compiled in
+void i2c_bus_list(FILE *f);
+
+#endif
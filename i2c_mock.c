@@ -0,0 +1,430 @@
+/*
+ * A pretend I2C bus full of ADT74x0s, so that the code can be run
+ * and timed without any hardware.
+ *
+ * Each chip has the full register map: temperature, STATUS, CONFIG,
+ * the threshold registers and IDREG, responds to RESET, and converts
+ * on the datasheet schedule for whichever mode CONFIG selects, so
+ * STATUS only says ready when a real chip would. Conversions are
+ * worked out lazily from CLOCK_MONOTONIC whenever a chip is touched.
+ *
+ * The path given to open configures the bus as comma separated
+ * key=value pairs, anything else (e.g. /dev/i2c-0) is ignored:
+ *
+ *   devs=48-4b    chips at these addresses (repeatable, default 48-4b)
+ *   temp=21.5     temperature of the chip at 0x48, each one above is
+ *                 0.5C warmer (default 21.5)
+ *   latency=100   microseconds per bus transaction (default 0)
+ *   nak=0.01      probability of any transaction failing (default 0)
+ *   conv=240      16-bit conversion time in ms (default 240)
+ *   seed=1        for the random number generator (default 1)
+ *   config=80     start with CONFIG already set to this (hex) and a
+ *                 conversion done, as if a previous run had set it up
+ *                 (default: just powered on)
+ *
+ * e.g. adt74x0 -b mock devs=48-49,latency=200,nak=0.05
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "i2c_bus.h"
+
+#define MOCK_ADDRS 128
+#define MOCK_REGS  0x30
+
+/* Registers, see adt74x0.h */
+#define R_T_MSB  0x00
+#define R_T_LSB  0x01
+#define R_STATUS 0x02
+#define R_CONFIG 0x03
+#define R_IDREG  0x0b
+#define R_RESET  0x2f
+
+/* CONFIG bits */
+#define C_16BIT    0x80
+#define C_MODE     0x60
+#define C_CTS      0x00
+#define C_ONE_SHOT 0x20
+#define C_1SPS     0x40
+#define C_SHUTDOWN 0x60
+
+/* STATUS bits */
+#define S_NRDY  0x80
+#define S_TCRIT 0x40
+#define S_THIGH 0x20
+#define S_TLOW  0x10
+
+/* ADT7410 and ADT7420 both say 0xcb */
+#define MOCK_ID 0xcb
+
+struct mock_chip
+{
+  int present;
+  uint8_t ptr;
+  uint8_t regs[MOCK_REGS];
+
+  double   temp;          // what the chip is sitting at
+  int64_t  conv_start;    // ns, when the next conversion starts
+  int      converting;
+};
+
+struct mock_bus
+{
+  struct mock_chip chips[MOCK_ADDRS];
+
+  long     latency_us;
+  double   nak;
+  int64_t  conv_ns;
+  uint64_t rng;
+  int      config;   // -1 if chips start just powered on
+
+  int      users;    // handles open on this bus
+};
+
+static int64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// xorshift64*, so runs are repeatable
+static double mock_random(struct mock_bus *m)
+{
+  m->rng ^= m->rng >> 12;
+  m->rng ^= m->rng << 25;
+  m->rng ^= m->rng >> 27;
+  return ((m->rng * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int16_t reg16(const struct mock_chip *c, int reg)
+{
+  return (int16_t)(c->regs[reg] << 8 | c->regs[reg + 1]);
+}
+
+static void power_on(struct mock_chip *c, int64_t now)
+{
+  memset(c->regs, 0, sizeof(c->regs));
+
+  c->regs[0x04] = 0x20; c->regs[0x05] = 0x00; // T_HIGH  64C
+  c->regs[0x06] = 0x05; c->regs[0x07] = 0x00; // T_LOW   10C
+  c->regs[0x08] = 0x49; c->regs[0x09] = 0x80; // T_CRIT 147C
+  c->regs[0x0a] = 0x05;                       // T_HYST   5C
+  c->regs[R_IDREG]  = MOCK_ID;
+  c->regs[R_STATUS] = S_NRDY;
+
+  c->ptr = 0;
+  c->converting = 1;
+  c->conv_start = now;
+}
+
+// Conversion time for the current mode, 0 if not converting
+static int64_t conv_time(const struct mock_bus *m, const struct mock_chip *c)
+{
+  switch(c->regs[R_CONFIG] & C_MODE)
+    {
+    case C_1SPS:     return m->conv_ns / 4;     // 60ms every second
+    case C_SHUTDOWN: return 0;
+    default:         return m->conv_ns;
+    }
+}
+
+static void finish_conversion(struct mock_bus *m, struct mock_chip *c)
+{
+  // A little noise: the real chips wobble by a few LSBs
+  double t = c->temp + (mock_random(m) - 0.5) / 16.0;
+
+  int16_t t128 = (int16_t)(t * 128.0);
+
+  uint8_t flags = 0;
+  if (t128 >= reg16(c, 0x08)) flags |= S_TCRIT;
+  if (t128 >  reg16(c, 0x04)) flags |= S_THIGH;
+  if (t128 <  reg16(c, 0x06)) flags |= S_TLOW;
+
+  if (!(c->regs[R_CONFIG] & C_16BIT))
+    {
+      // 13 bit: 1/16C resolution, with the flags in the bottom bits
+      t128 = (t128 & ~0x07) | (flags & S_TCRIT ? 4 : 0)
+	| (flags & S_THIGH ? 2 : 0) | (flags & S_TLOW ? 1 : 0);
+    }
+
+  c->regs[R_T_MSB]  = (uint16_t)t128 >> 8;
+  c->regs[R_T_LSB]  = t128 & 0xff;
+  c->regs[R_STATUS] = flags; // !NRDY i.e. ready
+}
+
+// Bring the chip up to date
+static void advance(struct mock_bus *m, struct mock_chip *c, int64_t now)
+{
+  if (!c->converting)
+    return;
+
+  int64_t t_conv = conv_time(m, c);
+  if (t_conv == 0)
+    return;
+
+  // 1 SPS starts a conversion every second, the others back-to-back
+  int64_t period = ((c->regs[R_CONFIG] & C_MODE) == C_1SPS) ? 1000000000 : t_conv;
+
+  if (now - c->conv_start < t_conv)
+    return;
+
+  // Skip over any conversions nobody looked at
+  c->conv_start += ((now - c->conv_start - t_conv) / period + 1) * period;
+
+  finish_conversion(m, c);
+
+  if ((c->regs[R_CONFIG] & C_MODE) == C_ONE_SHOT)
+    {
+      // one-shot drops into shutdown afterwards
+      c->regs[R_CONFIG] = (c->regs[R_CONFIG] & ~C_MODE) | C_SHUTDOWN;
+      c->converting = 0;
+    }
+}
+
+// Pretend to take the bus, and maybe fail. Return 0 if OK.
+static int transaction(struct i2c_bus *bus, int64_t *now)
+{
+  struct mock_bus *m = bus->priv;
+
+  bus->xfers++;
+
+  // Spin rather than sleep: timer slack would swamp short latencies
+  const int64_t until = now_ns() + (int64_t)m->latency_us * 1000;
+  while((*now = now_ns()) < until)
+    ;
+
+  return (m->nak > 0.0 && mock_random(m) < m->nak) ? -1 : 0;
+}
+
+static struct mock_chip *chip(struct mock_bus *m, uint8_t addr)
+{
+  struct mock_chip *c = &m->chips[addr & 0x7f];
+  return c->present ? c : NULL;
+}
+
+static void chip_write(struct mock_bus *m, struct mock_chip *c,
+		       const uint8_t *buf, int len, int64_t now)
+{
+  advance(m, c, now);
+
+  if (buf[0] == R_RESET)
+    {
+      power_on(c, now);
+      return;
+    }
+
+  c->ptr = buf[0];
+
+  for(int i = 1; i < len; i++)
+    {
+      uint8_t r = c->ptr;
+      if (r < MOCK_REGS && r != R_T_MSB && r != R_T_LSB
+	  && r != R_STATUS && r != R_IDREG)
+	c->regs[r] = buf[i];
+
+      if (r == R_CONFIG)
+	{
+	  // Writing CONFIG restarts conversions
+	  c->converting = 1;
+	  c->conv_start = now;
+	}
+
+      c->ptr++;
+    }
+}
+
+static void chip_read(struct mock_bus *m, struct mock_chip *c, uint8_t reg,
+		      uint8_t *buf, int len, int64_t now)
+{
+  advance(m, c, now);
+
+  c->ptr = reg;
+  for(int i = 0; i < len; i++)
+    {
+      buf[i] = (c->ptr < MOCK_REGS) ? c->regs[c->ptr] : 0;
+
+      // Reading the temperature makes STATUS say not ready again
+      if (c->ptr == R_T_MSB || c->ptr == R_T_LSB)
+	c->regs[R_STATUS] |= S_NRDY;
+
+      c->ptr++;
+    }
+}
+
+static int parse_config(struct mock_bus *m, const char *path)
+{
+  char *copy = strdup(path);
+  int   any_devs = 0;
+  int   stat = 0;
+  double temp = 21.5;
+
+  for(char *save, *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+      char *val = strchr(tok, '=');
+      if (!val)
+	continue;
+      *val++ = '\0';
+
+      if (strcmp(tok, "devs") == 0)
+	{
+	  char *end;
+	  long lo = strtol(val, &end, 16);
+	  long hi = (*end == '-') ? strtol(end + 1, NULL, 16) : lo;
+	  if (lo < 0 || hi >= MOCK_ADDRS || lo > hi)
+	    { stat = -2; break; }
+
+	  for(long a = lo; a <= hi; a++)
+	    m->chips[a].present = 1;
+	  any_devs = 1;
+	}
+      else if (strcmp(tok, "temp")    == 0) temp          = atof(val);
+      else if (strcmp(tok, "latency") == 0) m->latency_us = atol(val);
+      else if (strcmp(tok, "nak")     == 0) m->nak        = atof(val);
+      else if (strcmp(tok, "conv")    == 0) m->conv_ns    = (int64_t)(atof(val) * 1e6);
+      else if (strcmp(tok, "seed")    == 0) m->rng        = strtoull(val, NULL, 0) | 1;
+      else if (strcmp(tok, "config")  == 0) m->config     = strtol(val, NULL, 16) & 0xff;
+      else
+	{ stat = -2; break; }
+    }
+
+  free(copy);
+
+  if (!any_devs)
+    for(int a = 0x48; a <= 0x4b; a++)
+      m->chips[a].present = 1;
+
+  for(int a = 0; a < MOCK_ADDRS; a++)
+    m->chips[a].temp = temp + 0.5 * (a - 0x48);
+
+  return stat;
+}
+
+static int mock_open(struct i2c_bus *bus, const char *path)
+{
+  struct mock_bus *m = calloc(1, sizeof(*m));
+  if (!m)
+    return -1;
+
+  m->conv_ns = 240000000;
+  m->rng     = 1;
+  m->config  = -1;
+
+  if (parse_config(m, path) < 0)
+    {
+      free(m);
+      return -2;
+    }
+
+  int64_t now = now_ns();
+  for(int a = 0; a < MOCK_ADDRS; a++)
+    if (m->chips[a].present)
+      {
+	struct mock_chip *c = &m->chips[a];
+	power_on(c, now);
+
+	if (m->config >= 0)
+	  {
+	    c->regs[R_CONFIG] = m->config;
+	    finish_conversion(m, c);
+	  }
+      }
+
+  m->users  = 1;
+  bus->fd   = -1;
+  bus->priv = m;
+  return 0;
+}
+
+// Share the chips, like a second fd on the same /dev/i2c-N
+static int mock_reopen(struct i2c_bus *bus, const struct i2c_bus *from, const char *path)
+{
+  (void)path;
+
+  struct mock_bus *m = from->priv;
+  m->users++;
+
+  bus->fd   = -1;
+  bus->priv = m;
+  return 0;
+}
+
+static void mock_close(struct i2c_bus *bus)
+{
+  struct mock_bus *m = bus->priv;
+  if (--m->users == 0)
+    free(m);
+
+  bus->priv = NULL;
+}
+
+static int mock_set_addr(struct i2c_bus *bus, uint8_t addr)
+{
+  bus->addr = addr;
+  return 0;
+}
+
+static int mock_write(struct i2c_bus *bus, const uint8_t *buf, int len)
+{
+  struct mock_bus  *m = bus->priv;
+  struct mock_chip *c = chip(m, bus->addr);
+
+  int64_t now;
+  if (transaction(bus, &now) < 0 || !c || len < 1)
+    return -1;
+
+  chip_write(m, c, buf, len, now);
+  return 0;
+}
+
+static int mock_read_reg(struct i2c_bus *bus, uint8_t reg, uint8_t *buf, int len)
+{
+  struct mock_bus  *m = bus->priv;
+  struct mock_chip *c = chip(m, bus->addr);
+
+  int64_t now;
+  if (transaction(bus, &now) < 0 || !c)
+    return -1;
+
+  chip_read(m, c, reg, buf, len, now);
+  return 0;
+}
+
+// Like I2C_RDWR: one transaction, and it all fails if any part does
+static int mock_read_reg_many(struct i2c_bus *bus, const uint8_t *addrs, int n,
+			      uint8_t reg, uint8_t *buf, int len)
+{
+  struct mock_bus *m = bus->priv;
+
+  int64_t now;
+  if (transaction(bus, &now) < 0)
+    return -1;
+
+  for(int i = 0; i < n; i++)
+    if (!chip(m, addrs[i]))
+      return -1;
+
+  for(int i = 0; i < n; i++)
+    chip_read(m, chip(m, addrs[i]), reg, buf + i * len, len, now);
+
+  return 0;
+}
+
+const struct i2c_bus_ops i2c_mock_ops =
+  {
+    .name     = "mock",
+    .good_bus = 1,
+    .open     = mock_open,
+    .close    = mock_close,
+    .set_addr = mock_set_addr,
+    .write    = mock_write,
+    .read_reg = mock_read_reg,
+    .read_reg_many = mock_read_reg_many,
+    .reopen   = mock_reopen,
+  };
@@ -0,0 +1,107 @@
+/*
+ * I2C backend using the kernel's raw I2C_RDWR ioctl on /dev/i2c-N.
+ *
+ * Each message carries its own slave address, so selecting a
+ * slave costs nothing, and a register read is a single ioctl
+ * with a repeated start between the pointer write and the read.
+ * Better still, reads from several slaves can go in one ioctl.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "i2c_bus.h"
+
+static int rdwr_open(struct i2c_bus *bus, const char *path)
+{
+  bus->fd = open(path, O_RDWR);
+  return (bus->fd < 0) ? -1 : 0;
+}
+
+static void rdwr_close(struct i2c_bus *bus)
+{
+  close(bus->fd);
+}
+
+static int rdwr_set_addr(struct i2c_bus *bus, uint8_t addr)
+{
+  bus->addr = addr;
+  return 0;
+}
+
+static int rdwr_write(struct i2c_bus *bus, const uint8_t *buf, int len)
+{
+  struct i2c_msg msg =
+    { .addr = bus->addr, .flags = 0, .len = len, .buf = (uint8_t *)buf };
+
+  struct i2c_rdwr_ioctl_data data = { .msgs = &msg, .nmsgs = 1 };
+
+  bus->xfers++;
+  return (ioctl(bus->fd, I2C_RDWR, &data) < 0) ? -1 : 0;
+}
+
+static int rdwr_read_reg(struct i2c_bus *bus, uint8_t reg, uint8_t *buf, int len)
+{
+  struct i2c_msg msgs[2] =
+    {
+      { .addr = bus->addr, .flags = 0,        .len = 1,   .buf = &reg },
+      { .addr = bus->addr, .flags = I2C_M_RD, .len = len, .buf = buf  },
+    };
+
+  struct i2c_rdwr_ioctl_data data = { .msgs = msgs, .nmsgs = 2 };
+
+  bus->xfers++;
+  return (ioctl(bus->fd, I2C_RDWR, &data) < 0) ? -1 : 0;
+}
+
+static int rdwr_read_reg_many(struct i2c_bus *bus, const uint8_t *addrs, int n,
+			      uint8_t reg, uint8_t *buf, int len)
+{
+  struct i2c_msg msgs[I2C_RDWR_IOCTL_MAX_MSGS];
+
+  // Two messages per slave, and the kernel limits how many we can send
+  const int max_n = I2C_RDWR_IOCTL_MAX_MSGS / 2;
+
+  for(int done = 0; done < n; done += max_n)
+    {
+      const int m = (n - done > max_n) ? max_n : n - done;
+
+      for(int i = 0; i < m; i++)
+	{
+	  const uint8_t addr = addrs[done + i];
+	  msgs[2*i]   = (struct i2c_msg)
+	    { .addr = addr, .flags = 0,        .len = 1,   .buf = &reg };
+	  msgs[2*i+1] = (struct i2c_msg)
+	    { .addr = addr, .flags = I2C_M_RD, .len = len, .buf = buf + (done + i) * len };
+	}
+
+      struct i2c_rdwr_ioctl_data data = { .msgs = msgs, .nmsgs = 2 * m };
+
+      bus->xfers++;
+      if (ioctl(bus->fd, I2C_RDWR, &data) < 0)
+	return -1;
+    }
+
+  return 0;
+}
+
+const struct i2c_bus_ops i2c_rdwr_ops =
+  {
+    .name     = "rdwr",
+#ifdef GOOD_I2C_BUS
+    .good_bus = 1,
+#else
+    .good_bus = 0,
+#endif
+    .open     = rdwr_open,
+    .close    = rdwr_close,
+    .set_addr = rdwr_set_addr,
+    .write    = rdwr_write,
+    .read_reg = rdwr_read_reg,
+    .read_reg_many = rdwr_read_reg_many,
+  };
@@ -0,0 +1,116 @@
+/*
+ * I2C backend using the kernel's SMBus calls on /dev/i2c-N.
+ *
+ * Every transfer needs the slave selected with ioctl(I2C_SLAVE)
+ * first, though we remember which one is selected so repeatedly
+ * talking to the same chip doesn't cost an extra syscall each time.
+ * We're limited to the SMBus transaction types, but it works with
+ * pretty much any adapter.
+ *
+ * Part of adt74x0: see adt74x0.c for the LICENSE.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+
+#include "i2c_bus.h"
+
+static int smbus_open(struct i2c_bus *bus, const char *path)
+{
+  bus->fd   = open(path, O_RDWR);
+  bus->addr = I2C_NO_ADDR;
+  return (bus->fd < 0) ? -1 : 0;
+}
+
+// A second fd on the same adapter remembers its own I2C_SLAVE
+static int smbus_reopen(struct i2c_bus *bus, const struct i2c_bus *from, const char *path)
+{
+  (void)from;
+  return smbus_open(bus, path);
+}
+
+static void smbus_close(struct i2c_bus *bus)
+{
+  close(bus->fd);
+}
+
+static int smbus_set_addr(struct i2c_bus *bus, uint8_t addr)
+{
+  if (addr == bus->addr)
+    return 0;
+
+  bus->xfers++;
+
+  if (ioctl(bus->fd, I2C_SLAVE, addr) < 0)
+    {
+      bus->addr = I2C_NO_ADDR;
+      return -1;
+    }
+
+  bus->addr = addr;
+  return 0;
+}
+
+static int smbus_write(struct i2c_bus *bus, const uint8_t *buf, int len)
+{
+  int stat;
+
+  bus->xfers++;
+
+  // SMBus words go LSB first on the wire
+  switch(len)
+    {
+    case 1:  stat = i2c_smbus_write_byte(bus->fd, buf[0]);                          break;
+    case 2:  stat = i2c_smbus_write_byte_data(bus->fd, buf[0], buf[1]);             break;
+    case 3:  stat = i2c_smbus_write_word_data(bus->fd, buf[0], buf[1] | buf[2] << 8); break;
+    default: return -2;
+    }
+
+  return (stat < 0) ? -1 : 0;
+}
+
+static int smbus_read_reg(struct i2c_bus *bus, uint8_t reg, uint8_t *buf, int len)
+{
+  int stat;
+
+  bus->xfers++;
+
+  switch(len)
+    {
+    case 1:
+      if ((stat = i2c_smbus_read_byte_data(bus->fd, reg)) < 0)
+	return -1;
+      buf[0] = stat;
+      break;
+
+    case 2:
+      if ((stat = i2c_smbus_read_word_data(bus->fd, reg)) < 0)
+	return -1;
+      buf[0] = stat & 0xff;
+      buf[1] = (stat & 0xff00) >> 8;
+      break;
+
+    default:
+      return -2;
+    }
+
+  return 0;
+}
+
+const struct i2c_bus_ops i2c_smbus_ops =
+  {
+    .name     = "smbus",
+#ifdef GOOD_I2C_BUS
+    .good_bus = 1,
+#else
+    .good_bus = 0,
+#endif
+    .open     = smbus_open,
+    .close    = smbus_close,
+    .set_addr = smbus_set_addr,
+    .write    = smbus_write,
+    .read_reg = smbus_read_reg,
+    .reopen   = smbus_reopen,
+  };